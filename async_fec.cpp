@@ -1,13 +1,75 @@
 #include "async_fec.h"
 #include "config.h"
 #include "fec.h"
+#include "reedsolomon.h"
+#include "sess.h"
 
-AsyncFECInputer::AsyncFECInputer(OutputHandler o)
-    : AsyncInOutputer(o),
-      fec_(my_make_unique<FEC>(
-          FEC::New(3 * (FLAGS_datashard + FLAGS_parityshard), FLAGS_datashard, FLAGS_parityshard))) {}
+// Plain xor parity only applies to a single parity shard, and takes
+// precedence over --fecengine there.
+static codecType fec_codec() {
+    if (FLAGS_xorparity && FLAGS_parityshard == 1) {
+        return codecType::xorParity;
+    }
+    if (FLAGS_fecengine == "cauchy") {
+        return codecType::cauchy;
+    }
+    return codecType::reedSolomon;
+}
 
-void AsyncFECInputer::output_recovered(
+static int fec_interleave() { return std::max(1, FLAGS_fecinterleave); }
+
+// Groups the outputer keeps to answer requests for with --fecnack.
+static const int nackGroups = 64;
+
+static FEC new_fec() {
+    auto total = FLAGS_datashard + FLAGS_parityshard;
+    auto rxlimit = 3 * total * fec_interleave();
+    if (FLAGS_fecnack) {
+        // incomplete groups wait a round trip for their parity
+        rxlimit = std::max(rxlimit, nackGroups * total);
+    }
+    auto fec = FEC::New(rxlimit, FLAGS_datashard, FLAGS_parityshard,
+                        fec_codec(), fec_interleave());
+    fec.SetNack(FLAGS_fecnack);
+    return fec;
+}
+
+static std::vector<std::vector<row_type>> new_fec_groups() {
+    return std::vector<std::vector<row_type>>(
+        fec_interleave(),
+        std::vector<row_type>(FLAGS_datashard + FLAGS_parityshard, nullptr));
+}
+
+// Encodes the open groups and takes their parity out, in the order
+// FEC::MarkFEC numbers it.
+static std::vector<row_type> encode_fec_groups(FEC &fec,
+                                               std::vector<std::vector<row_type>> &groups) {
+    for (auto &g : groups) {
+        fec.Encode(g);
+    }
+    std::vector<row_type> parity;
+    parity.reserve(groups.size() * FLAGS_parityshard);
+    for (int i = 0; i < FLAGS_parityshard; i++) {
+        for (auto &g : groups) {
+            parity.push_back(std::move(g[FLAGS_datashard + i]));
+        }
+    }
+    return parity;
+}
+
+static std::shared_ptr<OffloadQueue> new_offload_queue(asio::io_service &service) {
+    if (FLAGS_fecoffload <= 0 ||
+        FLAGS_datashard + FLAGS_parityshard < FLAGS_fecoffload) {
+        return nullptr;
+    }
+    return std::make_shared<OffloadQueue>(service, WorkerPool::fec());
+}
+
+AsyncFECInputer::AsyncFECInputer(asio::io_service &service, OutputHandler o)
+    : AsyncFECInputerBase(o), fec_(std::make_shared<FEC>(new_fec())),
+      offload_(new_offload_queue(service)) {}
+
+void AsyncFECInputerBase::output_recovered(
     std::size_t len, std::shared_ptr<std::vector<row_type>> recovered,
     Handler handler) {
     if (!recovered || recovered->size() == 0) {
@@ -42,9 +104,53 @@ void AsyncFECInputer::output_recovered(
            });
 }
 
+void AsyncFECInputer::set_nack(OutputHandler nack,
+                               std::weak_ptr<AsyncFECOutputer> outputer) {
+    nack_ = nack;
+    outputer_ = outputer;
+}
+
+void AsyncFECInputer::send_nack(const std::vector<byte> &nack) {
+    if (nack_ && !nack.empty()) {
+        nack_((char *)nack.data(), nack.size(), nullptr);
+    }
+}
+
 void AsyncFECInputer::async_input(char *buf, std::size_t len, Handler handler) {
+    // The receive loops go on from 'handler', so every packet taken in,
+    // or dropped, completes it.
+    if (len < fecHeaderSizePlus2) {
+        if (handler) {
+            handler(errc(0), len);
+        }
+        return;
+    }
+    uint16_t flag;
+    decode16u((byte *)(buf + 4), &flag);
+    if (flag == typeNack) {
+        auto outputer = outputer_.lock();
+        if (outputer) {
+            outputer->on_nack((byte *)buf, len);
+        }
+        if (handler) {
+            handler(errc(0), len);
+        }
+        return;
+    }
+    if (flag == typeUnprotected) {
+        output(buf + fecHeaderSizePlus2, len - fecHeaderSizePlus2,
+               [len, handler](std::error_code ec, std::size_t) {
+                   if (handler) {
+                       handler(ec, len);
+                   }
+               });
+        return;
+    }
     auto pkt = fec_->Decode((byte *)buf, len);
     if (pkt.flag != typeData && pkt.flag != typeFEC) {
+        if (handler) {
+            handler(errc(0), len);
+        }
         return;
     }
     auto f = [pkt, handler, len, this](std::error_code ec,
@@ -55,8 +161,41 @@ void AsyncFECInputer::async_input(char *buf, std::size_t len, Handler handler) {
             }
             return;
         }
+        bool nack = bool(nack_);
+        if (offload_) {
+            // The FEC state is only touched by the queued jobs from here
+            // on. Recovered packets follow later, the caller need not wait.
+            auto fec = fec_;
+            auto recovered = std::make_shared<std::vector<row_type>>();
+            auto request = std::make_shared<std::vector<byte>>();
+            std::weak_ptr<AsyncFECInputer> ws = shared_from_this();
+            offload_->submit(
+                [fec, pkt, recovered, request, nack]() mutable {
+                    *recovered = fec->Input(pkt);
+                    if (nack) {
+                        request->resize(maxNackSize);
+                        request->resize(fec->NackDue(request->data()));
+                    }
+                },
+                [ws, recovered, request] {
+                    auto s = ws.lock();
+                    if (s) {
+                        s->send_nack(*request);
+                        s->output_recovered(0, recovered, nullptr);
+                    }
+                });
+            if (handler) {
+                handler(ec, len);
+            }
+            return;
+        }
         auto recovered =
             std::make_shared<std::vector<row_type>>(fec_->Input(pkt));
+        if (nack) {
+            std::vector<byte> request(maxNackSize);
+            request.resize(fec_->NackDue(request.data()));
+            send_nack(request);
+        }
         output_recovered(len, recovered, handler);
     };
     if (pkt.flag == typeData) {
@@ -73,7 +212,8 @@ static Buffers fec_header_buffers;
 
 static char *get_fec_header() {
     static ConstructCaller nopCaller([](){
-        fec_header_buffers.reset(fecHeaderSize*FLAGS_parityshard);
+        fec_header_buffers.reset(fecHeaderSize * FLAGS_parityshard *
+                                 fec_interleave());
     });
     return fec_header_buffers.get();
 }
@@ -84,23 +224,106 @@ static void push_fec_header_back(char *buf) {
 
 
 
-AsyncFECOutputer::AsyncFECOutputer(OutputHandler o)
-    : AsyncInOutputer(o),
-      fec_(my_make_unique<FEC>(
-          FEC::New(3 * (FLAGS_datashard + FLAGS_parityshard), FLAGS_datashard, FLAGS_parityshard))),
-      shards_(my_make_unique<std::vector<row_type>>(FLAGS_datashard + FLAGS_parityshard,
-                                                      nullptr)) {}
+AsyncFECOutputer::AsyncFECOutputer(asio::io_service &service, OutputHandler o)
+    : AsyncInOutputer(o), fec_(std::make_shared<FEC>(new_fec())),
+      groups_(my_make_unique<std::vector<std::vector<row_type>>>(new_fec_groups())),
+      offload_(new_offload_queue(service)) {}
+
+void AsyncFECOutputer::output_parity(const std::vector<row_type> &parity,
+                                     char *fec_headers) {
+    char *buffer = fec_buffers.get();
+    for (size_t i = 0; i < parity.size(); i++) {
+        memcpy(buffer, fec_headers + i * fecHeaderSize, fecHeaderSize);
+        memcpy(buffer + fecHeaderSize, parity[i]->data(), parity[i]->size());
+        output(buffer, parity[i]->size() + fecHeaderSize, nullptr);
+    }
+    fec_buffers.push_back(buffer);
+}
+
+void AsyncFECOutputer::keep_groups(char *fec_headers) {
+    // parity shard i of group g was marked i*interleave+g
+    auto interleave = groups_->size();
+    for (size_t g = 0; g < interleave; g++) {
+        sentGroup sg;
+        sg.shards = std::move((*groups_)[g]);
+        for (size_t i = g; i < FLAGS_parityshard * interleave; i += interleave) {
+            auto h = (byte *)fec_headers + i * fecHeaderSize;
+            sg.headers.insert(sg.headers.end(), h, h + fecHeaderSize);
+        }
+        decode32u(sg.headers.data(), &sg.begin);
+        sg.begin -= sg.begin % uint32_t(FLAGS_datashard + FLAGS_parityshard);
+        sent_.push_back(std::move(sg));
+    }
+    *groups_ = new_fec_groups();
+    while (sent_.size() > nackGroups) {
+        sent_.pop_front();
+    }
+}
+
+void AsyncFECOutputer::on_nack(const byte *nack, std::size_t len) {
+    if (len < fecHeaderSizePlus2) {
+        return;
+    }
+    uint16_t count;
+    decode16u((byte *)nack + fecHeaderSize, &count);
+    if (len < fecHeaderSizePlus2 + count * nackEntrySize) {
+        return;
+    }
+    char *buffer = fec_buffers.get();
+    auto p = (byte *)nack + fecHeaderSizePlus2;
+    for (int n = 0; n < count; n++) {
+        uint32_t begin;
+        p = decode32u(p, &begin);
+        int wanted = *p++;
+        for (auto &sg : sent_) {
+            if (sg.begin != begin) {
+                continue;
+            }
+            if (!sg.encoded) {
+                fec_->Encode(sg.shards);
+                sg.encoded = true;
+            }
+            wanted = std::min(wanted, FLAGS_parityshard);
+            for (int i = 0; i < wanted; i++) {
+                auto &shard = sg.shards[FLAGS_datashard + i];
+                memcpy(buffer, sg.headers.data() + i * fecHeaderSize,
+                       fecHeaderSize);
+                memcpy(buffer + fecHeaderSize, shard->data(), shard->size());
+                output(buffer, shard->size() + fecHeaderSize, nullptr);
+            }
+            break;
+        }
+    }
+    fec_buffers.push_back(buffer);
+}
 
 void AsyncFECOutputer::async_input(char *buf, std::size_t len,
                                    Handler handler) {
+    if (FLAGS_fecskipack && kcp_ack_only(buf, len)) {
+        // Acks are resent by KCP anyway and not worth parity, so they go
+        // outside the groups, leaving seqids and parity to the data.
+        byte *p = encode32u(buf_, 0);
+        p = encode16u(p, typeUnprotected);
+        encode16u(p, static_cast<uint16_t>(len + 2));
+        memcpy(buf_ + fecHeaderSizePlus2, buf, len);
+        output((char *)buf_, len + fecHeaderSizePlus2,
+               [len, handler](std::error_code ec, std::size_t) {
+                   if (handler) {
+                       handler(ec, len);
+                   }
+               });
+        return;
+    }
     memcpy(buf_ + fecHeaderSizePlus2, buf, len);
     fec_->MarkData(buf_, len + fecHeaderSizePlus2);
     auto slen = len + 2;
-    assert(pkt_idx_ < (FLAGS_datashard + FLAGS_parityshard));
-    (*shards_)[pkt_idx_] = std::make_shared<std::vector<byte>>(
-        &(buf_[fecHeaderSize]), &(buf_[fecHeaderSize + slen]));
+    auto interleave = groups_->size();
+    assert(pkt_idx_ < FLAGS_datashard * interleave);
+    (*groups_)[pkt_idx_ % interleave][pkt_idx_ / interleave] =
+        std::make_shared<std::vector<byte>>(&(buf_[fecHeaderSize]),
+                                            &(buf_[fecHeaderSize + slen]));
     pkt_idx_++;
-    if (pkt_idx_ < FLAGS_datashard) {
+    if (pkt_idx_ < FLAGS_datashard * interleave) {
         output((char *)buf_, len + fecHeaderSizePlus2,
                [this, len, handler](std::error_code ec, std::size_t) {
                    if (handler) {
@@ -111,31 +334,324 @@ void AsyncFECOutputer::async_input(char *buf, std::size_t len,
         return;
     }
     pkt_idx_ = 0;
-    fec_->Encode(*shards_);
-    char *buffer = fec_buffers.get();
-    std::vector<row_type> shards(FLAGS_parityshard, nullptr);
     char *fec_headers = get_fec_header();
-    for (int i = 0; i < FLAGS_parityshard; i++) {
-        shards[i] = (*shards_)[FLAGS_datashard + i];
-        (*shards_)[FLAGS_datashard + i] = nullptr;
+    for (size_t i = 0; i < FLAGS_parityshard * interleave; i++) {
         fec_->MarkFEC((byte *)(fec_headers + fecHeaderSize * i));
     }
+
+    if (FLAGS_fecnack) {
+        // most groups are never asked for, so they are only encoded then
+        keep_groups(fec_headers);
+        push_fec_header_back(fec_headers);
+        output((char *)buf_, len + fecHeaderSizePlus2,
+               [len, handler](std::error_code ec, std::size_t) {
+                   if (handler) {
+                       handler(ec, len);
+                   }
+               });
+        return;
+    }
+
+    if (offload_) {
+        // The groups are handed over whole and encoded on the workers; their
+        // parity follows once done, while the next groups go on.
+        auto groups = std::make_shared<std::vector<std::vector<row_type>>>(
+            new_fec_groups());
+        groups->swap(*groups_);
+        auto parity = std::make_shared<std::vector<row_type>>();
+        auto fec = fec_;
+        std::weak_ptr<AsyncFECOutputer> ws = shared_from_this();
+        offload_->submit([fec, groups, parity] {
+                             *parity = encode_fec_groups(*fec, *groups);
+                         },
+                         [ws, parity, fec_headers] {
+                             auto s = ws.lock();
+                             if (s) {
+                                 s->output_parity(*parity, fec_headers);
+                             }
+                             push_fec_header_back(fec_headers);
+                         });
+        output((char *)buf_, len + fecHeaderSizePlus2,
+               [len, handler](std::error_code ec, std::size_t) {
+                   if (handler) {
+                       handler(ec, len);
+                   }
+               });
+        return;
+    }
+
+    auto shards = encode_fec_groups(*fec_, *groups_);
     output((char *)buf_, len + fecHeaderSizePlus2,
-           [this, len, handler, buffer, fec_headers, shards](std::error_code ec,
-                                                             std::size_t) {
-               DeferCaller defer([buffer, fec_headers, ec, handler, len] {
-                   fec_buffers.push_back(buffer);
+           [this, len, handler, fec_headers, shards](std::error_code ec,
+                                                     std::size_t) {
+               DeferCaller defer([fec_headers, ec, handler, len] {
                    push_fec_header_back(fec_headers);
                    if (handler) {
                        handler(ec, len);
                    }
                });
-               for (int i = 0; i < FLAGS_parityshard; i++) {
-                   memcpy(buffer, fec_headers + i * fecHeaderSize,
-                          fecHeaderSize);
-                   memcpy(buffer + fecHeaderSize, shards[i]->data(),
-                          shards[i]->size());
-                   output(buffer, shards[i]->size() + fecHeaderSize, nullptr);
-               }
+               output_parity(shards, fec_headers);
            });
-}
\ No newline at end of file
+}
+
+AsyncSlidingFECInputer::AsyncSlidingFECInputer(OutputHandler o)
+    : AsyncFECInputerBase(o),
+      dec_(my_make_unique<slidingDecoder>(slidingDecoder::New(FLAGS_fecwindow))) {}
+
+void AsyncSlidingFECInputer::async_input(char *buf, std::size_t len,
+                                         Handler handler) {
+    if (len < fecHeaderSizePlus2) {
+        if (handler) {
+            handler(errc(0), len);
+        }
+        return;
+    }
+    auto pkt = FEC::Decode((byte *)buf, len);
+    if (pkt.flag != typeData && pkt.flag != typeRepair) {
+        if (handler) {
+            handler(errc(0), len);
+        }
+        return;
+    }
+    auto f = [pkt, handler, len, this](std::error_code ec,
+                                       std::size_t) mutable {
+        if (ec) {
+            if (handler) {
+                handler(ec, len);
+            }
+            return;
+        }
+        auto recovered =
+            std::make_shared<std::vector<row_type>>(dec_->Input(pkt));
+        output_recovered(len, recovered, handler);
+    };
+    if (pkt.flag == typeData) {
+        auto ptr = pkt.data->data();
+        output((char *)(ptr + 2), pkt.data->size() - 2, f);
+    } else {
+        f(std::error_code(0, std::generic_category()), len);
+    }
+}
+
+AsyncSlidingFECOutputer::AsyncSlidingFECOutputer(OutputHandler o)
+    : AsyncInOutputer(o),
+      enc_(my_make_unique<slidingEncoder>(slidingEncoder::New(
+          FLAGS_fecwindow, FLAGS_datashard, FLAGS_parityshard))) {}
+
+void AsyncSlidingFECOutputer::async_input(char *buf, std::size_t len,
+                                          Handler handler) {
+    memcpy(buf_ + fecHeaderSizePlus2, buf, len);
+    enc_->MarkData(buf_, len + fecHeaderSizePlus2);
+    int repairs = enc_->RepairsDue();
+    if (repairs == 0) {
+        output((char *)buf_, len + fecHeaderSizePlus2,
+               [len, handler](std::error_code ec, std::size_t) {
+                   if (handler) {
+                       handler(ec, len);
+                   }
+               });
+        return;
+    }
+
+    // Repair packets follow the source packet that completes the run,
+    // built right away so they cover it.
+    char *buffer = fec_buffers.get();
+    output((char *)buf_, len + fecHeaderSizePlus2, nullptr);
+    for (int i = 0; i < repairs; i++) {
+        auto n = enc_->EncodeRepair((byte *)buffer);
+        if (i + 1 < repairs) {
+            output(buffer, n, nullptr);
+            continue;
+        }
+        output(buffer, n, [buffer, len, handler](std::error_code ec,
+                                                 std::size_t) {
+            fec_buffers.push_back(buffer);
+            if (handler) {
+                handler(ec, len);
+            }
+        });
+    }
+}
+
+AsyncFountainFECOutputer::AsyncFountainFECOutputer(OutputHandler o)
+    : AsyncInOutputer(o),
+      enc_(my_make_unique<fountainEncoder>(
+          fountainEncoder::New(FLAGS_datashard, FLAGS_parityshard))) {}
+
+void AsyncFountainFECOutputer::async_input(char *buf, std::size_t len,
+                                           Handler handler) {
+    memcpy(buf_ + fecHeaderSizePlus2, buf, len);
+    enc_->MarkData(buf_, len + fecHeaderSizePlus2);
+    int repairs = enc_->RepairsDue();
+    if (repairs == 0) {
+        output((char *)buf_, len + fecHeaderSizePlus2,
+               [len, handler](std::error_code ec, std::size_t) {
+                   if (handler) {
+                       handler(ec, len);
+                   }
+               });
+        return;
+    }
+
+    // The block is complete, its repair symbols follow right away.
+    char *buffer = fec_buffers.get();
+    output((char *)buf_, len + fecHeaderSizePlus2, nullptr);
+    for (int i = 0; i < repairs; i++) {
+        auto n = enc_->EncodeRepair((byte *)buffer);
+        if (i + 1 < repairs) {
+            output(buffer, n, nullptr);
+            continue;
+        }
+        output(buffer, n, [buffer, len, handler](std::error_code ec,
+                                                 std::size_t) {
+            fec_buffers.push_back(buffer);
+            if (handler) {
+                handler(ec, len);
+            }
+        });
+    }
+}
+
+AsyncFountainFECInputer::AsyncFountainFECInputer(OutputHandler o)
+    : AsyncFECInputerBase(o),
+      dec_(my_make_unique<fountainDecoder>(
+          fountainDecoder::New(FLAGS_datashard))) {}
+
+void AsyncFountainFECInputer::set_feedback(
+    OutputHandler feedback, std::weak_ptr<AsyncFountainFECOutputer> outputer) {
+    feedback_ = feedback;
+    outputer_ = outputer;
+}
+
+void AsyncFountainFECInputer::async_input(char *buf, std::size_t len,
+                                          Handler handler) {
+    if (len < fecHeaderSizePlus2) {
+        if (handler) {
+            handler(errc(0), len);
+        }
+        return;
+    }
+    auto pkt = FEC::Decode((byte *)buf, len);
+    if (pkt.flag == typeFeedback) {
+        uint16_t loss;
+        decode16u(pkt.data->data(), &loss);
+        auto outputer = outputer_.lock();
+        if (outputer) {
+            outputer->on_feedback(loss);
+        }
+        if (handler) {
+            handler(errc(0), len);
+        }
+        return;
+    }
+    if (pkt.flag != typeData && pkt.flag != typeRepairSymbol) {
+        if (handler) {
+            handler(errc(0), len);
+        }
+        return;
+    }
+    auto f = [pkt, handler, len, this](std::error_code ec,
+                                       std::size_t) mutable {
+        if (ec) {
+            if (handler) {
+                handler(ec, len);
+            }
+            return;
+        }
+        auto recovered =
+            std::make_shared<std::vector<row_type>>(dec_->Input(pkt));
+        if (feedback_ && dec_->FeedbackDue(feedback_buf_)) {
+            feedback_((char *)feedback_buf_, feedbackSize, nullptr);
+        }
+        output_recovered(len, recovered, handler);
+    };
+    if (pkt.flag == typeData) {
+        auto ptr = pkt.data->data();
+        output((char *)(ptr + 2), pkt.data->size() - 2, f);
+    } else {
+        f(std::error_code(0, std::generic_category()), len);
+    }
+}
+
+static bool use_sliding_fec() { return FLAGS_fecmode == "sliding"; }
+
+static bool use_fountain_fec() { return FLAGS_fecmode == "fountain"; }
+
+std::shared_ptr<AsyncInOutputer> make_fec_inputer(asio::io_service &service,
+                                                  OutputHandler o) {
+    if (use_sliding_fec()) {
+        return std::make_shared<AsyncSlidingFECInputer>(o);
+    }
+    if (use_fountain_fec()) {
+        return std::make_shared<AsyncFountainFECInputer>(o);
+    }
+    return std::make_shared<AsyncFECInputer>(service, o);
+}
+
+std::shared_ptr<AsyncInOutputer> make_fec_outputer(asio::io_service &service,
+                                                   OutputHandler o) {
+    if (use_sliding_fec()) {
+        return std::make_shared<AsyncSlidingFECOutputer>(o);
+    }
+    if (use_fountain_fec()) {
+        return std::make_shared<AsyncFountainFECOutputer>(o);
+    }
+    return std::make_shared<AsyncFECOutputer>(service, o);
+}
+
+bool fec_ack_only(const char *buf, std::size_t len) {
+    if (len < fecHeaderSizePlus2) {
+        return false;
+    }
+    uint16_t flag;
+    decode16u((byte *)(buf + 4), &flag);
+    if (flag == typeUnprotected) {
+        return true;
+    }
+    return flag == typeData &&
+           kcp_ack_only(buf + fecHeaderSizePlus2, len - fecHeaderSizePlus2);
+}
+
+void link_fec_stages(std::shared_ptr<AsyncInOutputer> in,
+                     std::shared_ptr<AsyncInOutputer> out, OutputHandler raw) {
+    auto fountain_in = std::dynamic_pointer_cast<AsyncFountainFECInputer>(in);
+    auto fountain_out = std::dynamic_pointer_cast<AsyncFountainFECOutputer>(out);
+    if (fountain_in && fountain_out) {
+        fountain_in->set_feedback(raw, fountain_out);
+    }
+    auto block_in = std::dynamic_pointer_cast<AsyncFECInputer>(in);
+    auto block_out = std::dynamic_pointer_cast<AsyncFECOutputer>(out);
+    if (block_in && block_out && FLAGS_fecnack) {
+        block_in->set_nack(raw, block_out);
+    }
+}
+
+std::function<bool()> fec_recovery_hint(std::shared_ptr<AsyncInOutputer> in) {
+    auto block_in = std::dynamic_pointer_cast<AsyncFECInputer>(in);
+    if (!block_in || FLAGS_fecholdack <= 0) {
+        return nullptr;
+    }
+    std::weak_ptr<AsyncFECInputer> wi = block_in;
+    return [wi] {
+        auto in = wi.lock();
+        return in && in->recovery_pending();
+    };
+}
+
+void precompute_fec_matrices() {
+    if (FLAGS_fecprecompute <= 0 || FLAGS_datashard <= 0 ||
+        FLAGS_parityshard <= 0 || use_sliding_fec() || use_fountain_fec() ||
+        fec_codec() != codecType::reedSolomon) {
+        return;
+    }
+    auto bytes = ReedSolomon::Precompute(
+        FLAGS_datashard, FLAGS_parityshard, FLAGS_fecprecompute,
+        FLAGS_fecprecomputeasync, [](std::size_t pinned) {
+            LOG(INFO) << "fec decode matrices pinned: " << pinned / 1024
+                      << " KB";
+        });
+    if (FLAGS_fecprecomputeasync && bytes > 0) {
+        LOG(INFO) << "fec decode matrices: about " << bytes / 1024
+                  << " KB, built in the background";
+    }
+}
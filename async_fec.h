@@ -3,27 +3,146 @@
 
 #include "utils.h"
 #include "fec.h"
+#include "worker_pool.h"
+#include "sliding_fec.h"
+#include "fountain_fec.h"
 
-class AsyncFECInputer : public AsyncInOutputer {
+class AsyncFECInputerBase : public AsyncInOutputer {
 public:
-    AsyncFECInputer(OutputHandler o = nullptr);
-    void async_input(char *buf, std::size_t len, Handler handler) override;
+    AsyncFECInputerBase(OutputHandler o = nullptr) : AsyncInOutputer(o) {}
+    // Outputs the payloads of recovered symbols one after another.
     void output_recovered(std::size_t len, std::shared_ptr<std::vector<row_type>> recovered, Handler handler);
+};
+
+// With --fecoffload, groups of that many shards or more are coded on the
+// FEC worker pool instead of the io_service thread.
+// With --fecinterleave, that many groups are filled round-robin at once,
+// see FEC::New.
+// With --fecnack, no parity is sent up front. The inputer asks for it for
+// groups that miss shards, and the outputer keeps the data shards of its
+// recent groups and encodes a group's parity once it is asked for.
+class AsyncFECOutputer;
+
+class AsyncFECInputer : public AsyncFECInputerBase,
+                        public std::enable_shared_from_this<AsyncFECInputer> {
+public:
+    AsyncFECInputer(asio::io_service &service, OutputHandler o = nullptr);
+    void async_input(char *buf, std::size_t len, Handler handler) override;
+    // Parity requests go out through 'nack', below the FEC outputer, and
+    // the peer's requests are handed to 'outputer'.
+    void set_nack(OutputHandler nack, std::weak_ptr<AsyncFECOutputer> outputer);
+    // See FEC::RecoveryPending. Always false when offloaded, as the FEC
+    // state then belongs to the workers.
+    bool recovery_pending() const { return !offload_ && fec_->RecoveryPending(); }
 
 private:
-    std::unique_ptr<FEC> fec_;
+    void send_nack(const std::vector<byte> &nack);
+
+    std::shared_ptr<FEC> fec_;
+    std::shared_ptr<OffloadQueue> offload_;
+    OutputHandler nack_;
+    std::weak_ptr<AsyncFECOutputer> outputer_;
 };
 
-class AsyncFECOutputer : public AsyncInOutputer {
+class AsyncFECOutputer : public AsyncInOutputer,
+                         public std::enable_shared_from_this<AsyncFECOutputer> {
 public:
-    AsyncFECOutputer(OutputHandler o = nullptr);
+    AsyncFECOutputer(asio::io_service &service, OutputHandler o = nullptr);
     void async_input(char *buf, std::size_t len, Handler handler) override;
+    // Parity requested by the peer's inputer, a typeNack packet.
+    void on_nack(const byte *nack, std::size_t len);
 
 private:
+    // Sends the parity shards of the open groups behind their headers,
+    // in the order they were marked.
+    void output_parity(const std::vector<row_type> &parity, char *fec_headers);
+    // Keeps the open groups unencoded with their parity headers, for
+    // --fecnack.
+    void keep_groups(char *fec_headers);
+
+    struct sentGroup {
+        uint32_t begin; // first seqid
+        std::vector<row_type> shards; // parity included once encoded
+        std::vector<byte> headers;
+        bool encoded = false;
+    };
+
     byte buf_[2048];
     uint32_t pkt_idx_ = 0;
-    std::unique_ptr<FEC> fec_;
-    std::unique_ptr<std::vector<row_type>> shards_;
+    std::shared_ptr<FEC> fec_;
+    std::unique_ptr<std::vector<std::vector<row_type>>> groups_;
+    std::shared_ptr<OffloadQueue> offload_;
+    std::deque<sentGroup> sent_;
+};
+
+class AsyncSlidingFECInputer : public AsyncFECInputerBase {
+public:
+    AsyncSlidingFECInputer(OutputHandler o = nullptr);
+    void async_input(char *buf, std::size_t len, Handler handler) override;
+
+private:
+    std::unique_ptr<slidingDecoder> dec_;
+};
+
+class AsyncSlidingFECOutputer : public AsyncInOutputer {
+public:
+    AsyncSlidingFECOutputer(OutputHandler o = nullptr);
+    void async_input(char *buf, std::size_t len, Handler handler) override;
+
+private:
+    byte buf_[2048];
+    std::unique_ptr<slidingEncoder> enc_;
+};
+
+class AsyncFountainFECOutputer : public AsyncInOutputer {
+public:
+    AsyncFountainFECOutputer(OutputHandler o = nullptr);
+    void async_input(char *buf, std::size_t len, Handler handler) override;
+    // Loss reported by the peer's inputer.
+    void on_feedback(uint16_t loss) { enc_->Feedback(loss); }
+
+private:
+    byte buf_[2048];
+    std::unique_ptr<fountainEncoder> enc_;
+};
+
+class AsyncFountainFECInputer : public AsyncFECInputerBase {
+public:
+    AsyncFountainFECInputer(OutputHandler o = nullptr);
+    void async_input(char *buf, std::size_t len, Handler handler) override;
+    // Loss reports go out through 'feedback', below the FEC outputer, and
+    // the peer's reports are handed to 'outputer'.
+    void set_feedback(OutputHandler feedback,
+                      std::weak_ptr<AsyncFountainFECOutputer> outputer);
+
+private:
+    byte feedback_buf_[feedbackSize];
+    OutputHandler feedback_;
+    std::weak_ptr<AsyncFountainFECOutputer> outputer_;
+    std::unique_ptr<fountainDecoder> dec_;
 };
 
+// Creates the FEC stages for --fecmode.
+std::shared_ptr<AsyncInOutputer> make_fec_inputer(asio::io_service &service,
+                                                  OutputHandler o);
+std::shared_ptr<AsyncInOutputer> make_fec_outputer(asio::io_service &service,
+                                                   OutputHandler o);
+
+// Reports whether a datagram from a FEC outputer carries nothing but KCP
+// acks and window probes.
+bool fec_ack_only(const char *buf, std::size_t len);
+
+// Connects the FEC stages of one end for modes that talk back to the
+// peer. 'raw' sends a packet below the FEC outputer.
+void link_fec_stages(std::shared_ptr<AsyncInOutputer> in,
+                     std::shared_ptr<AsyncInOutputer> out, OutputHandler raw);
+
+// Returns the hint a Session holds its acks on with --fecholdack, or
+// nullptr when the inputer 'in' gives none.
+std::function<bool()> fec_recovery_hint(std::shared_ptr<AsyncInOutputer> in);
+
+// Pins decode matrices for the configured shard shape when
+// --fecprecompute is set, so early losses don't pay for matrix inversion.
+void precompute_fec_matrices();
+
 #endif
@@ -0,0 +1,387 @@
+#include "cauchy.h"
+#include "galois_noasm.h"
+#include <stdexcept>
+#include <string.h>
+
+// Decode schedules kept per coder, as many as ReedSolomon keeps matrices.
+static const std::size_t decodeScheduleCacheSize = 256;
+
+// bitRow returns row r of the 8x8 bit-matrix of e: bit k is set when input
+// packet k contributes to output packet r. Column k of the bit-matrix is e
+// times x^k, so the expansion respects both addition and multiplication.
+static inline byte bitRow(byte e, int r) {
+    byte row = 0;
+    for (int k = 0; k < 8; k++) {
+        if ((galMultiply(e, byte(1 << k)) >> r) & 1) {
+            row |= byte(1 << k);
+        }
+    }
+    return row;
+}
+
+// Number of ones in the bit-matrix of e, i.e. the xors it costs.
+static int bitOnes(byte e) {
+    int n = 0;
+    for (int k = 0; k < 8; k++) {
+        n += __builtin_popcount(galMultiply(e, byte(1 << k)));
+    }
+    return n;
+}
+
+CauchyCoder CauchyCoder::New(int dataShards, int parityShards) {
+    if (dataShards <= 0 || parityShards <= 0) {
+        throw std::invalid_argument(
+            "cannot create Encoder with zero or less data/parity shards");
+    }
+
+    if (dataShards + parityShards > 255) {
+        throw std::invalid_argument(
+            "cannot create Encoder with 255 or more data+parity shards");
+    }
+
+    CauchyCoder c;
+    c.m_dataShards = dataShards;
+    c.m_parityShards = parityShards;
+    c.m_totalShards = dataShards + parityShards;
+
+    // The Cauchy matrix 1/(x_i + y_j) with x_i = i and y_j = p + j. The
+    // two sets are disjoint, so every square submatrix is invertible and
+    // so is every square subset of rows of [I; C].
+    c.m = matrix::newMatrix(c.m_totalShards, dataShards);
+    for (int i = 0; i < dataShards; i++) {
+        c.m.at(i, i) = 1;
+    }
+    for (int i = 0; i < parityShards; i++) {
+        for (int j = 0; j < dataShards; j++) {
+            c.m.at(dataShards + i, j) =
+                galDivide(1, byte(i ^ (parityShards + j)));
+        }
+    }
+
+    // Scaling a column or a parity row by a nonzero constant keeps that
+    // property. Make the first parity row all ones, which is the cheapest
+    // row there is, then scale each other row by whichever of its elements
+    // leaves the fewest ones in its bit-matrix.
+    for (int j = 0; j < dataShards; j++) {
+        byte f = c.m.at(dataShards, j);
+        for (int i = 0; i < parityShards; i++) {
+            c.m.at(dataShards + i, j) = galDivide(c.m.at(dataShards + i, j), f);
+        }
+    }
+    for (int i = 1; i < parityShards; i++) {
+        auto &row = *c.m.data[dataShards + i];
+        byte best = 1;
+        int bestOnes = 0;
+        for (int j = 0; j < dataShards; j++) {
+            bestOnes += bitOnes(row[j]);
+        }
+        for (int k = 0; k < dataShards; k++) {
+            int ones = 0;
+            for (int j = 0; j < dataShards; j++) {
+                ones += bitOnes(galDivide(row[j], row[k]));
+            }
+            if (ones < bestOnes) {
+                best = row[k];
+                bestOnes = ones;
+            }
+        }
+        for (int j = 0; j < dataShards; j++) {
+            row[j] = galDivide(row[j], best);
+        }
+    }
+
+    c.parity.resize(parityShards * dataShards);
+    for (int i = 0; i < parityShards; i++) {
+        std::copy(c.m.data[dataShards + i]->begin(),
+                  c.m.data[dataShards + i]->end(),
+                  c.parity.begin() + i * dataShards);
+    }
+    c.encodeSchedule = makeSchedule(c.parity.data(), parityShards, dataShards);
+    return c;
+}
+
+std::vector<CauchyCoder::xorOp>
+CauchyCoder::makeSchedule(const byte *elements, int rows, int cols) {
+    int inputPackets = cols * 8;
+    int outputPackets = rows * 8;
+    int words = (inputPackets + 63) / 64;
+
+    // Expand the element matrix into one bit vector per output packet.
+    std::vector<uint64_t> bits(std::size_t(outputPackets) * words, 0);
+    for (int i = 0; i < rows; i++) {
+        for (int j = 0; j < cols; j++) {
+            byte e = elements[i * cols + j];
+            if (e == 0) {
+                continue;
+            }
+            for (int r = 0; r < 8; r++) {
+                byte row = bitRow(e, r);
+                uint64_t *dst = &bits[std::size_t(i * 8 + r) * words];
+                for (int k = 0; k < 8; k++) {
+                    if ((row >> k) & 1) {
+                        int b = j * 8 + k;
+                        dst[b >> 6] |= uint64_t(1) << (b & 63);
+                    }
+                }
+            }
+        }
+    }
+
+    auto distance = [&](int a, int b) {
+        int n = 0;
+        for (int w = 0; w < words; w++) {
+            uint64_t x = bits[std::size_t(a) * words + w];
+            if (b >= 0) {
+                x ^= bits[std::size_t(b) * words + w];
+            }
+            n += __builtin_popcountll(x);
+        }
+        return n;
+    };
+
+    std::vector<xorOp> ops;
+    for (int t = 0; t < outputPackets; t++) {
+        // From scratch a row costs its ones minus one copy; starting from
+        // an earlier output costs one copy plus the differing bits.
+        int ones = distance(t, -1);
+        int from = -1;
+        int cost = ones - 1;
+        for (int u = 0; u < t; u++) {
+            int d = distance(t, u);
+            if (d < cost) {
+                from = u;
+                cost = d;
+            }
+        }
+
+        const uint64_t *row = &bits[std::size_t(t) * words];
+        std::vector<uint64_t> diff(row, row + words);
+        bool first = true;
+        if (from >= 0) {
+            const uint64_t *base = &bits[std::size_t(from) * words];
+            for (int w = 0; w < words; w++) {
+                diff[w] ^= base[w];
+            }
+            ops.push_back(xorOp{inputPackets + from, t, true});
+            first = false;
+        } else if (ones == 0) {
+            ops.push_back(xorOp{-1, t, true});
+            continue;
+        }
+        for (int b = 0; b < inputPackets; b++) {
+            if ((diff[b >> 6] >> (b & 63)) & 1) {
+                ops.push_back(xorOp{b, t, first});
+                first = false;
+            }
+        }
+    }
+    return ops;
+}
+
+void CauchyCoder::runSchedule(const std::vector<xorOp> &ops, int inputCount,
+                              const byte *const *inputs, byte *const *outputs,
+                              std::size_t packetSize) {
+    int inputPackets = inputCount * 8;
+    for (auto &op : ops) {
+        byte *out = outputs[op.dst >> 3] + (op.dst & 7) * packetSize;
+        if (op.src < 0) {
+            memset(out, 0, packetSize);
+            continue;
+        }
+        const byte *in;
+        if (op.src < inputPackets) {
+            in = inputs[op.src >> 3] + (op.src & 7) * packetSize;
+        } else {
+            int o = op.src - inputPackets;
+            in = outputs[o >> 3] + (o & 7) * packetSize;
+        }
+        if (op.copy) {
+            memcpy(out, in, packetSize);
+        } else {
+            galXorSlice(in, out, packetSize);
+        }
+    }
+}
+
+void CauchyCoder::Encode(std::vector<row_type> &shards) {
+    if (shards.size() != m_totalShards) {
+        throw std::invalid_argument("too few shards given");
+    }
+
+    checkShards(shards, false);
+
+    std::vector<const byte *> input(m_dataShards);
+    for (int i = 0; i < m_dataShards; i++) {
+        input[i] = shards[i]->data();
+    }
+    std::vector<byte *> output(m_parityShards);
+    for (int i = 0; i < m_parityShards; i++) {
+        output[i] = shards[m_dataShards + i]->data();
+    }
+    runSchedule(encodeSchedule, m_dataShards, input.data(), output.data(),
+                shards[0]->size() / 8);
+}
+
+void CauchyCoder::Reconstruct(std::vector<row_type> &shards) {
+    reconstruct(shards, nullptr, false);
+}
+
+void CauchyCoder::ReconstructData(std::vector<row_type> &shards) {
+    reconstruct(shards, nullptr, true);
+}
+
+void CauchyCoder::ReconstructData(std::vector<row_type> &shards,
+                                  std::vector<byte *> &dst) {
+    if (dst.size() < m_dataShards) {
+        throw std::invalid_argument("too few destination buffers given");
+    }
+    reconstruct(shards, &dst, true);
+}
+
+void CauchyCoder::reconstruct(std::vector<row_type> &shards,
+                              std::vector<byte *> *dst, bool dataOnly) {
+    if (shards.size() != m_totalShards) {
+        throw std::invalid_argument("too few shards given");
+    }
+
+    checkShards(shards, true);
+
+    std::size_t shardSize = 0;
+    int numberPresent = 0;
+    int dataPresent = 0;
+    for (int i = 0; i < m_totalShards; i++) {
+        if (shards[i] != nullptr) {
+            shardSize = shards[i]->size();
+            numberPresent++;
+            if (i < m_dataShards) {
+                dataPresent++;
+            }
+        }
+    }
+
+    if (numberPresent == m_totalShards ||
+        (dataOnly && dataPresent == m_dataShards)) {
+        return;
+    }
+
+    if (numberPresent < m_dataShards) {
+        throw std::invalid_argument("too few shards given");
+    }
+
+    // The first dataShards present shards are the input, exactly as in
+    // ReedSolomon. Every missing data row comes before the last of them,
+    // so the mask of invalid rows also tells which data shards to decode.
+    std::vector<const byte *> subShards(m_dataShards);
+    std::vector<int> validIndices(m_dataShards);
+    erasureMask invalidMask;
+    int subMatrixRow = 0;
+    for (int matrixRow = 0;
+         matrixRow < m_totalShards && subMatrixRow < m_dataShards;
+         matrixRow++) {
+        if (shards[matrixRow] != nullptr) {
+            subShards[subMatrixRow] = shards[matrixRow]->data();
+            validIndices[subMatrixRow] = matrixRow;
+            subMatrixRow++;
+        } else {
+            invalidMask.set(matrixRow);
+        }
+    }
+
+    std::vector<byte *> outputs;
+    std::vector<byte> rows;
+    if (dataPresent < m_dataShards) {
+        auto it = decodeSchedules.find(invalidMask);
+        if (it == decodeSchedules.end()) {
+            // Invert the rows we have, keep the rows of the inverse that
+            // give the missing data shards and turn them into xors.
+            auto subMatrix = matrix::newMatrix(m_dataShards, m_dataShards);
+            for (int r = 0; r < m_dataShards; r++) {
+                for (int c = 0; c < m_dataShards; c++) {
+                    subMatrix.at(r, c) = m.at(validIndices[r], c);
+                }
+            }
+            auto inverted = subMatrix.Invert();
+            if (inverted.empty()) {
+                throw std::runtime_error("cannot get matrix invert");
+            }
+            for (int iShard = 0; iShard < m_dataShards; iShard++) {
+                if (shards[iShard] == nullptr) {
+                    rows.insert(rows.end(), inverted.data[iShard]->begin(),
+                                inverted.data[iShard]->end());
+                }
+            }
+            if (decodeSchedules.size() >= decodeScheduleCacheSize) {
+                decodeSchedules.clear();
+            }
+            it = decodeSchedules
+                     .emplace(invalidMask,
+                              makeSchedule(rows.data(),
+                                           int(rows.size()) / m_dataShards,
+                                           m_dataShards))
+                     .first;
+        }
+
+        for (int iShard = 0; iShard < m_dataShards; iShard++) {
+            if (shards[iShard] != nullptr) {
+                continue;
+            }
+            if (dst != nullptr) {
+                outputs.push_back((*dst)[iShard]);
+            } else {
+                shards[iShard] =
+                    std::make_shared<std::vector<byte>>(shardSize);
+                outputs.push_back(shards[iShard]->data());
+            }
+        }
+        runSchedule(it->second, m_dataShards, subShards.data(),
+                    outputs.data(), shardSize / 8);
+    }
+
+    if (dataOnly) {
+        return;
+    }
+
+    // Missing parity is encoded again from the now complete data.
+    for (int iShard = 0; iShard < m_dataShards; iShard++) {
+        subShards[iShard] = shards[iShard]->data();
+    }
+    outputs.clear();
+    rows.clear();
+    for (int iShard = m_dataShards; iShard < m_totalShards; iShard++) {
+        if (shards[iShard] == nullptr) {
+            shards[iShard] = std::make_shared<std::vector<byte>>(shardSize);
+            outputs.push_back(shards[iShard]->data());
+            auto p = &parity[(iShard - m_dataShards) * m_dataShards];
+            rows.insert(rows.end(), p, p + m_dataShards);
+        }
+    }
+    auto ops = makeSchedule(rows.data(), int(outputs.size()), m_dataShards);
+    runSchedule(ops, m_dataShards, subShards.data(), outputs.data(),
+                shardSize / 8);
+}
+
+void CauchyCoder::checkShards(std::vector<row_type> &shards, bool nilok) {
+    std::size_t size = 0;
+    for (auto &s : shards) {
+        if (s != nullptr) {
+            size = s->size();
+            break;
+        }
+    }
+    if (size == 0) {
+        throw std::invalid_argument("no shard data");
+    }
+    if (size % 8 != 0) {
+        throw std::invalid_argument("shard size is not a multiple of 8");
+    }
+
+    for (auto &s : shards) {
+        if (s == nullptr) {
+            if (!nilok) {
+                throw std::invalid_argument("shard sizes does not match");
+            }
+        } else if (s->size() != size) {
+            throw std::invalid_argument("shard sizes does not match");
+        }
+    }
+}
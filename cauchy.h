@@ -0,0 +1,82 @@
+#ifndef KCP_CAUCHY_H
+#define KCP_CAUCHY_H
+
+#include "erasure_coder.h"
+#include "matrix_cache.h"
+#include <unordered_map>
+
+// CauchyCoder is an MDS erasure code built on a Cauchy matrix over GF(2^8)
+// where every element is expanded into its 8x8 bit-matrix. Each shard is
+// cut into 8 packets and every output packet becomes an xor of input
+// packets, so coding needs no multiplication tables at all. The xors are
+// ordered by a schedule that derives a row from an earlier one whenever
+// that takes fewer xors than starting from scratch.
+//
+// Shards must be a multiple of 8 bytes long. The code is not compatible
+// with ReedSolomon; both ends must use the same engine.
+class CauchyCoder : public ErasureCoder {
+public:
+    CauchyCoder() = default;
+
+    // New creates a coder for the given shape, at most 255 shards in total.
+    static CauchyCoder New(int dataShards, int parityShards);
+
+    void Encode(std::vector<row_type> &shards) override;
+
+    void Reconstruct(std::vector<row_type> &shards) override;
+
+    void ReconstructData(std::vector<row_type> &shards) override;
+
+    void ReconstructData(std::vector<row_type> &shards,
+                         std::vector<byte *> &dst) override;
+
+    int ShardAlignment() const override { return 8; }
+
+    // XorCount returns the number of packet xors (copies included) one
+    // Encode does, for comparing against the dense d*p*8*8 bit-matrix.
+    std::size_t XorCount() const { return encodeSchedule.size(); }
+
+private:
+    // xorOp xors (or copies) packet src into output packet dst. Packets
+    // below inputPackets are input packets, the rest are outputs computed
+    // earlier in the same schedule. src < 0 zero-fills dst.
+    struct xorOp {
+        int src;
+        int dst;
+        bool copy;
+    };
+
+    // Builds the schedule computing the outputs of the rows x cols element
+    // matrix 'elements' from cols input shards.
+    static std::vector<xorOp> makeSchedule(const byte *elements, int rows,
+                                           int cols);
+
+    static void runSchedule(const std::vector<xorOp> &ops, int inputCount,
+                            const byte *const *inputs, byte *const *outputs,
+                            std::size_t packetSize);
+
+    void reconstruct(std::vector<row_type> &shards, std::vector<byte *> *dst,
+                     bool dataOnly);
+
+    void checkShards(std::vector<row_type> &shards, bool nilok);
+
+    struct maskHash {
+        std::size_t operator()(const erasureMask &mask) const {
+            return std::size_t(mask.hash());
+        }
+    };
+
+    int m_dataShards{0};
+    int m_parityShards{0};
+    int m_totalShards{0};
+
+    matrix m;                 // identity on top of the Cauchy rows
+    std::vector<byte> parity; // parity rows of m, contiguous
+    std::vector<xorOp> encodeSchedule;
+
+    // Data decode schedules keyed by the mask of the invalid rows, which
+    // also fixes the data shards to decode. Dropped as a whole when full.
+    std::unordered_map<erasureMask, std::vector<xorOp>, maskHash> decodeSchedules;
+};
+
+#endif // KCP_CAUCHY_H
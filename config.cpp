@@ -12,8 +12,12 @@ DEFINE_string(t, "", "alias for targetaddr");
 DEFINE_string(c, "", "config from json file, which will override the command from shell");
 DEFINE_string(key, "it's a secret", "pre-shared secret between client and server");
 DEFINE_string(crypt, "aes", "aes, aes-128, aes-192, salsa20, blowfish, twofish, cast5, 3des, tea, xtea, xor, none");
-DEFINE_string(mode, "fast", "profiles: fast3, fast2, fast, normal");
+DEFINE_string(mode, "fast", "profiles: fast3, fast2, fast, normal, lossy");
 DEFINE_string(logfile, "", "specify a log file to output, default goes to stdout");
+DEFINE_string(fecengine, "rs", "erasure code engine: rs, cauchy, must be the same on both sides");
+DEFINE_string(fecmode, "block", "fec mode: block, sliding, fountain, must be the same on both sides");
+DEFINE_string(cc, "", "congestion control: kcp, none, bbr, the profile's if empty, either side may differ");
+DEFINE_string(kcpcore, "ikcp", "kcp implementation: ikcp, ring for windows in the thousands, either side may differ");
 
 DEFINE_int32(conn, 1, "set num of UDP connections to server");
 DEFINE_int32(autoexpire, 0, "set auto expiration time(in seconds) for a single UDP connection, 0 to disable");
@@ -32,39 +36,74 @@ DEFINE_int32(nc, 0, "");
 DEFINE_int32(interval, 40, "");
 DEFINE_int32(sockbuf, 4194304, "socket buffer size");
 DEFINE_int32(keepalive, 10, "keepalive interval in seconds");
+DEFINE_int32(fecprecompute, 0, "precompute fec decode matrices for up to N lost shards at startup, 0 to disable");
+DEFINE_int32(fecwindow, 32, "sliding fec: number of recent packets each repair packet covers");
+DEFINE_int32(fecoffload, 0, "code fec groups of at least this many shards on worker threads, 0 to disable");
+DEFINE_int32(fecworkers, 2, "number of fec worker threads");
+DEFINE_int32(fecholdack, 0, "hold kcp datagrams of nothing but acks for up to this many ms while block fec is about to recover a packet, 0 to disable");
+DEFINE_int32(fecinterleave, 1, "fill this many fec groups round-robin to survive burst loss, must be the same on both sides");
+DEFINE_int32(paceburst, 10, "packets that may leave back to back when pacing");
+DEFINE_int32(pacemax, 0, "highest pacing rate in Mbit/s, 0 for no limit");
 
 DEFINE_bool(nocomp, false, "disable compression");
+DEFINE_bool(kcpslab, true, "allocate kcp segments from pooled slabs instead of malloc");
+DEFINE_bool(coarseclock, false, "read the clock from CLOCK_MONOTONIC_COARSE, cheaper but only a few ms fine");
+DEFINE_bool(kernelpace, false, "let the fq qdisc pace packets, by SO_MAX_PACING_RATE on the client and SO_TXTIME on the server, where supported, else pace as --pace");
+DEFINE_bool(coupled, false, "client: couple the windows of the --conn sessions (LIA) so together they take a single flow's share, in place of --cc");
+DEFINE_bool(pace, false, "space packets out at twice the measured delivery rate instead of sending each flush in a burst");
+DEFINE_bool(fastflush, false, "flush small writes after an idle gap at once, for interactive streams");
 DEFINE_bool(acknodelay, true, "flush ack immediately when a packet is received");
 DEFINE_bool(kvar, false, "run default kvar printer");
+DEFINE_bool(fecprecomputeasync, true, "precompute fec decode matrices in a background thread");
+DEFINE_bool(fecnack, false, "block fec: send parity only when the peer reports missing shards, must be the same on both sides");
+DEFINE_bool(fecskipack, false, "send ack-only kcp packets outside the fec groups, the peer must support it");
+DEFINE_bool(xorparity, false, "use plain xor parity when parityshard is 1, must be the same on both sides");
 
 using namespace rapidjson;
 
 void print_configs() {
-    char buffer[1024];
-    snprintf(buffer, 1024, "listening on: %s\n"
+    char buffer[2048];
+    snprintf(buffer, sizeof(buffer), "listening on: %s\n"
                  "encryption: %s\n"
-                 "nodelay parameters: %d %d %d %d\n"
+                 "nodelay parameters: %d %d %d %d cc: %s coupled: %s\n"
                  "remote address: %s\n"
                  "target address: %s\n"
                  "sndwnd: %d rcvwnd: %d\n"
                  "compression: %s\n"
-                 "mtu: %d\n"
-                 "datashard: %d parityshard: %d\n"
-                 "acknodelay: %s\n"
+                 "mtu: %d kcpcore: %s\n"
+                 "datashard: %d parityshard: %d xorparity: %s fecengine: %s\n"
+                 "fecmode: %s fecwindow: %d\n"
+                 "fecoffload: %d fecworkers: %d fecinterleave: %d\n"
+                 "fecskipack: %s fecnack: %s fecholdack: %d\n"
+                 "acknodelay: %s fastflush: %s coarseclock: %s kcpslab: %s\n"
+                 "pace: %s kernelpace: %s paceburst: %d pacemax: %d\n"
                  "dscp: %d\n"
                  "sockbuf: %d\n"
                  "keepalive: %d\n"
                  "conn: %d\n"
                  "autoexpire: %d\n"
-                 "scavengettl: %d\n",
+                 "scavengettl: %d\n"
+                 "fecprecompute: %d async: %s\n",
          FLAGS_localaddr.c_str(),
          FLAGS_crypt.c_str(),
          FLAGS_nodelay, FLAGS_interval, FLAGS_resend, FLAGS_nc,
+         FLAGS_cc.c_str(), get_bool_str(FLAGS_coupled),
          FLAGS_remoteaddr.c_str(),
          FLAGS_targetaddr.c_str(),
          FLAGS_sndwnd, FLAGS_rcvwnd, get_bool_str(!FLAGS_nocomp), FLAGS_mtu,
-         FLAGS_datashard, FLAGS_parityshard, get_bool_str(FLAGS_acknodelay), FLAGS_dscp, FLAGS_sockbuf,
-         FLAGS_keepalive, FLAGS_conn, FLAGS_autoexpire, FLAGS_scavengettl);
+         FLAGS_kcpcore.c_str(),
+         FLAGS_datashard, FLAGS_parityshard, get_bool_str(FLAGS_xorparity),
+         FLAGS_fecengine.c_str(), FLAGS_fecmode.c_str(), FLAGS_fecwindow,
+         FLAGS_fecoffload, FLAGS_fecworkers, FLAGS_fecinterleave,
+         get_bool_str(FLAGS_fecskipack), get_bool_str(FLAGS_fecnack),
+         FLAGS_fecholdack,
+         get_bool_str(FLAGS_acknodelay), get_bool_str(FLAGS_fastflush),
+         get_bool_str(FLAGS_coarseclock), get_bool_str(FLAGS_kcpslab),
+         get_bool_str(FLAGS_pace), get_bool_str(FLAGS_kernelpace),
+         FLAGS_paceburst, FLAGS_pacemax,
+         FLAGS_dscp, FLAGS_sockbuf,
+         FLAGS_keepalive, FLAGS_conn, FLAGS_autoexpire, FLAGS_scavengettl,
+         FLAGS_fecprecompute, get_bool_str(FLAGS_fecprecomputeasync));
     LOG(INFO) << buffer;
 }
 
@@ -103,6 +142,10 @@ static std::unordered_map<std::string, std::tuple<void *, std::function<void (ch
     {"crypt", std::make_tuple(&FLAGS_crypt, env_assign_string)},
     {"logfile", std::make_tuple(&FLAGS_logfile, env_assign_string)},
     {"mode", std::make_tuple(&FLAGS_mode, env_assign_string)},
+    {"cc", std::make_tuple(&FLAGS_cc, env_assign_string)},
+    {"fecengine", std::make_tuple(&FLAGS_fecengine, env_assign_string)},
+    {"fecmode", std::make_tuple(&FLAGS_fecmode, env_assign_string)},
+    {"kcpcore", std::make_tuple(&FLAGS_kcpcore, env_assign_string)},
 
     {"conn", std::make_tuple(&FLAGS_conn, env_assign_int32)},
     {"autoexpire", std::make_tuple(&FLAGS_autoexpire, env_assign_int32)},
@@ -118,10 +161,28 @@ static std::unordered_map<std::string, std::tuple<void *, std::function<void (ch
     {"interval", std::make_tuple(&FLAGS_interval, env_assign_int32)},
     {"sockbuf", std::make_tuple(&FLAGS_sockbuf, env_assign_int32)},
     {"keepalive", std::make_tuple(&FLAGS_keepalive, env_assign_int32)},
+    {"fecprecompute", std::make_tuple(&FLAGS_fecprecompute, env_assign_int32)},
+    {"fecwindow", std::make_tuple(&FLAGS_fecwindow, env_assign_int32)},
+    {"fecoffload", std::make_tuple(&FLAGS_fecoffload, env_assign_int32)},
+    {"fecinterleave", std::make_tuple(&FLAGS_fecinterleave, env_assign_int32)},
+    {"paceburst", std::make_tuple(&FLAGS_paceburst, env_assign_int32)},
+    {"pacemax", std::make_tuple(&FLAGS_pacemax, env_assign_int32)},
+    {"fecholdack", std::make_tuple(&FLAGS_fecholdack, env_assign_int32)},
+    {"fecworkers", std::make_tuple(&FLAGS_fecworkers, env_assign_int32)},
 
     {"nocomp", std::make_tuple(&FLAGS_nocomp, env_assign_bool)},
     {"acknodelay", std::make_tuple(&FLAGS_acknodelay, env_assign_bool)},
+    {"fastflush", std::make_tuple(&FLAGS_fastflush, env_assign_bool)},
+    {"pace", std::make_tuple(&FLAGS_pace, env_assign_bool)},
+    {"coupled", std::make_tuple(&FLAGS_coupled, env_assign_bool)},
+    {"kernelpace", std::make_tuple(&FLAGS_kernelpace, env_assign_bool)},
+    {"coarseclock", std::make_tuple(&FLAGS_coarseclock, env_assign_bool)},
+    {"kcpslab", std::make_tuple(&FLAGS_kcpslab, env_assign_bool)},
     {"kvar", std::make_tuple(&FLAGS_kvar, env_assign_bool)},
+    {"fecprecomputeasync", std::make_tuple(&FLAGS_fecprecomputeasync, env_assign_bool)},
+    {"xorparity", std::make_tuple(&FLAGS_xorparity, env_assign_bool)},
+    {"fecskipack", std::make_tuple(&FLAGS_fecskipack, env_assign_bool)},
+    {"fecnack", std::make_tuple(&FLAGS_fecnack, env_assign_bool)},
 };
 
 static void
@@ -270,7 +331,11 @@ void parse_command_lines(int argc, char **argv) {
     get_string_assigner("key", &FLAGS_key);
     get_string_assigner("crypt", &FLAGS_crypt);
     get_string_assigner("mode", &FLAGS_mode);
+    get_string_assigner("cc", &FLAGS_cc);
     get_string_assigner("logfile", &FLAGS_logfile);
+    get_string_assigner("fecengine", &FLAGS_fecengine);
+    get_string_assigner("fecmode", &FLAGS_fecmode);
+    get_string_assigner("kcpcore", &FLAGS_kcpcore);
 
     get_int_assigner("conn", &FLAGS_conn);
     get_int_assigner("autoexpire", &FLAGS_autoexpire);
@@ -287,10 +352,28 @@ void parse_command_lines(int argc, char **argv) {
     get_int_assigner("sockbuf", &FLAGS_sockbuf);
     get_int_assigner("keepalive", &FLAGS_keepalive);
     get_int_assigner("interval", &FLAGS_interval);
+    get_int_assigner("fecprecompute", &FLAGS_fecprecompute);
+    get_int_assigner("fecwindow", &FLAGS_fecwindow);
+    get_int_assigner("fecoffload", &FLAGS_fecoffload);
+    get_int_assigner("fecinterleave", &FLAGS_fecinterleave);
+    get_int_assigner("paceburst", &FLAGS_paceburst);
+    get_int_assigner("pacemax", &FLAGS_pacemax);
+    get_int_assigner("fecholdack", &FLAGS_fecholdack);
+    get_int_assigner("fecworkers", &FLAGS_fecworkers);
 
     get_bool_assigner("kvar", &FLAGS_kvar);
     get_bool_assigner("nocomp", &FLAGS_nocomp);
     get_bool_assigner("acknodelay", &FLAGS_acknodelay);
+    get_bool_assigner("fastflush", &FLAGS_fastflush);
+    get_bool_assigner("pace", &FLAGS_pace);
+    get_bool_assigner("coupled", &FLAGS_coupled);
+    get_bool_assigner("kernelpace", &FLAGS_kernelpace);
+    get_bool_assigner("coarseclock", &FLAGS_coarseclock);
+    get_bool_assigner("kcpslab", &FLAGS_kcpslab);
+    get_bool_assigner("fecprecomputeasync", &FLAGS_fecprecomputeasync);
+    get_bool_assigner("xorparity", &FLAGS_xorparity);
+    get_bool_assigner("fecskipack", &FLAGS_fecskipack);
+    get_bool_assigner("fecnack", &FLAGS_fecnack);
 
     for (auto &m : d.GetObject()) {
         if (!m.name.IsString()) {
@@ -338,23 +421,30 @@ std::string get_port(const std::string &addr) {
 }
 
 void process_configs() {
-    auto assigner = [](int nodelay, int interval, int resend, int nc) -> std::function<void()> {
-        return [nodelay, interval, resend, nc]() {
+    auto assigner = [](int nodelay, int interval, int resend, std::string cc) -> std::function<void()> {
+        return [nodelay, interval, resend, cc]() {
             FLAGS_nodelay = nodelay;
             FLAGS_interval = interval;
             FLAGS_resend = resend;
-            FLAGS_nc = nc;
+            if (FLAGS_cc.empty()) {
+                FLAGS_cc = cc;
+            }
         };
     };
     std::unordered_map<std::string, std::function<void()>> handlers = {
-            {"normal", assigner(0, 40, 2, 1)},
-            {"fast",   assigner(0, 30, 2, 1)},
-            {"fast2",  assigner(1, 20, 2, 1)},
-            {"fast3",  assigner(1, 10, 2, 1)},
+            {"normal", assigner(0, 40, 2, "none")},
+            {"fast",   assigner(0, 30, 2, "none")},
+            {"fast2",  assigner(1, 20, 2, "none")},
+            {"fast3",  assigner(1, 10, 2, "none")},
+            {"lossy",  assigner(1, 10, 2, "bbr")},
     };
     auto it = handlers.find(FLAGS_mode);
-    if (it == handlers.end()) {
-        return;
+    if (it != handlers.end()) {
+        (it->second)();
+    }
+    // without a profile --nc picks between KCP's window and none
+    if (FLAGS_cc.empty()) {
+        FLAGS_cc = FLAGS_nc ? "none" : "kcp";
     }
-    (it->second)();
+    FLAGS_nc = FLAGS_cc == "kcp" ? 0 : 1;
 }
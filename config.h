@@ -10,6 +10,10 @@ DECLARE_string(key);
 DECLARE_string(crypt);
 DECLARE_string(mode);
 DECLARE_string(logfile);
+DECLARE_string(fecengine);
+DECLARE_string(fecmode);
+DECLARE_string(kcpcore);
+DECLARE_string(cc);
 
 DECLARE_int32(conn);
 DECLARE_int32(autoexpire);
@@ -26,10 +30,28 @@ DECLARE_int32(nc);
 DECLARE_int32(sockbuf);
 DECLARE_int32(keepalive);
 DECLARE_int32(interval);
+DECLARE_int32(fecprecompute);
+DECLARE_int32(fecwindow);
+DECLARE_int32(fecoffload);
+DECLARE_int32(fecinterleave);
+DECLARE_int32(fecholdack);
+DECLARE_int32(fecworkers);
+DECLARE_int32(paceburst);
+DECLARE_int32(pacemax);
 
 DECLARE_bool(kvar);
 DECLARE_bool(nocomp);
 DECLARE_bool(acknodelay);
+DECLARE_bool(fastflush);
+DECLARE_bool(pace);
+DECLARE_bool(coupled);
+DECLARE_bool(kernelpace);
+DECLARE_bool(coarseclock);
+DECLARE_bool(kcpslab);
+DECLARE_bool(fecprecomputeasync);
+DECLARE_bool(xorparity);
+DECLARE_bool(fecskipack);
+DECLARE_bool(fecnack);
 
 void parse_command_lines(int argc, char **argv);
 
@@ -0,0 +1,272 @@
+#include "congestion.h"
+#include "config.h"
+
+namespace {
+
+const double highGain = 2.885; // 2/ln2, doubles the sending rate each round
+const double cycleGains[] = {1.25, 0.75, 1, 1, 1, 1, 1, 1};
+const int cycleLength = sizeof(cycleGains) / sizeof(cycleGains[0]);
+const uint32_t initialCwnd = 16;
+const uint32_t minCwnd = 4;
+const uint64_t minRttWindowUs = 10 * 1000 * 1000;
+const uint64_t probeRttUs = 200 * 1000;
+
+inline int32_t diff(uint32_t later, uint32_t earlier) {
+    return int32_t(later - earlier);
+}
+
+class WindowCongestion : public Congestion {
+public:
+    WindowCongestion(std::size_t segment, bool kcp)
+        : delivery_(segment), kcp_(kcp) {}
+
+    void on_ack(uint64_t now_us, uint32_t una, uint32_t nxt,
+                uint32_t delivered, uint32_t srtt_ms,
+                bool app_limited) override {
+        srtt_ = srtt_ms;
+        delivery_.sample(now_us, delivered, srtt_ms, app_limited);
+    }
+
+    void on_loss(uint64_t now_us, uint32_t sn) override {}
+
+    double pacing_rate() const override {
+        // Twice the delivery rate leaves a flow room to double each round
+        // trip. Before there is a rate, a full window goes out over a round
+        // trip, or unpaced before there is a round trip either.
+        auto rate = 2 * delivery_.rate();
+        if (rate == 0 && srtt_ > 0) {
+            rate = double(FLAGS_sndwnd) * FLAGS_mtu / srtt_;
+        }
+        return rate;
+    }
+
+    uint32_t cwnd() const override { return 0; }
+
+    bool kcp_window() const override { return kcp_; }
+
+private:
+    DeliveryRate delivery_;
+    bool kcp_;
+    uint32_t srtt_ = 0;
+};
+
+} // namespace
+
+std::unique_ptr<Congestion> Congestion::New(const std::string &name,
+                                            std::size_t segment) {
+    if (name == "bbr") {
+        return std::unique_ptr<Congestion>(new Bbr(segment));
+    }
+    return std::unique_ptr<Congestion>(
+            new WindowCongestion(segment, name == "kcp"));
+}
+
+Bbr::Bbr(std::size_t segment)
+    : segment_(segment), bw_(segment), pacing_gain_(highGain),
+      cwnd_gain_(highGain) {}
+
+void Bbr::on_ack(uint64_t now_us, uint32_t una, uint32_t nxt,
+                 uint32_t delivered, uint32_t srtt_ms, bool app_limited) {
+    inflight_ = nxt - una;
+    bw_.sample(now_us, delivered, srtt_ms, app_limited);
+
+    bool expired = min_rtt_ != 0 && now_us - min_rtt_us_ > minRttWindowUs;
+    if (srtt_ms > 0 && (min_rtt_ == 0 || srtt_ms <= min_rtt_ || expired)) {
+        min_rtt_ = srtt_ms;
+        min_rtt_us_ = now_us;
+    }
+    // a round trip ends when what was sent at its start is acknowledged
+    round_start_ = diff(una, round_end_) >= 0 && diff(nxt, round_end_) > 0;
+    if (round_start_) {
+        round_end_ = nxt;
+        round_us_ = round_at_us_ != 0 ? now_us - round_at_us_ : 0;
+        round_at_us_ = now_us;
+    }
+
+    switch (mode_) {
+    case Mode::startup:
+        if (round_start_ && !app_limited) {
+            check_full_bw();
+        }
+        if (filled_) {
+            mode_ = Mode::drain;
+            pacing_gain_ = 1 / highGain;
+            cwnd_gain_ = highGain;
+        }
+        break;
+    case Mode::drain:
+        if (inflight_ <= bdp()) {
+            enter_probe_bw(now_us);
+        }
+        break;
+    case Mode::probe_bw:
+        // the 3/4 phase may end early, once it has drained what 5/4 queued
+        if (now_us - cycle_us_ > uint64_t(min_rtt_) * 1000 ||
+            (pacing_gain_ < 1 && inflight_ <= bdp())) {
+            cycle_ = (cycle_ + 1) % cycleLength;
+            cycle_us_ = now_us;
+            pacing_gain_ = cycleGains[cycle_];
+        }
+        break;
+    case Mode::probe_rtt:
+        if (probe_rtt_done_us_ == 0 && inflight_ <= minCwnd) {
+            probe_rtt_done_us_ = now_us + probeRttUs;
+        } else if (probe_rtt_done_us_ != 0 && now_us >= probe_rtt_done_us_) {
+            leave_probe_rtt(now_us);
+        }
+        break;
+    }
+
+    if (expired && mode_ != Mode::probe_rtt) {
+        mode_ = Mode::probe_rtt;
+        pacing_gain_ = 1;
+        probe_rtt_done_us_ = 0;
+    }
+}
+
+void Bbr::check_full_bw() {
+    // the pipe is full once three rounds in a row add less than a quarter
+    auto bw = bw_.rate();
+    if (bw >= full_bw_ * 1.25) {
+        full_bw_ = bw;
+        full_bw_rounds_ = 0;
+        return;
+    }
+    if (++full_bw_rounds_ >= 3) {
+        filled_ = true;
+    }
+}
+
+void Bbr::enter_probe_bw(uint64_t now_us) {
+    mode_ = Mode::probe_bw;
+    cwnd_gain_ = 2;
+    // start anywhere but the 3/4 phase, so flows sharing a path spread out
+    cycle_ = int(now_us % (cycleLength - 1));
+    if (cycle_ >= 1) {
+        cycle_++;
+    }
+    cycle_us_ = now_us;
+    pacing_gain_ = cycleGains[cycle_];
+}
+
+void Bbr::leave_probe_rtt(uint64_t now_us) {
+    min_rtt_us_ = now_us;
+    probe_rtt_done_us_ = 0;
+    if (filled_) {
+        enter_probe_bw(now_us);
+    } else {
+        mode_ = Mode::startup;
+        pacing_gain_ = highGain;
+        cwnd_gain_ = highGain;
+    }
+}
+
+double Bbr::bdp() const {
+    return bw_.rate() * min_rtt_ / double(segment_);
+}
+
+double Bbr::pacing_rate() const {
+    auto bw = bw_.rate();
+    if (bw == 0) {
+        // before the first sample, the initial window over a round trip
+        if (min_rtt_ == 0) {
+            return 0;
+        }
+        bw = double(initialCwnd) * segment_ / min_rtt_;
+    }
+    return pacing_gain_ * bw;
+}
+
+uint32_t Bbr::cwnd() const {
+    if (mode_ == Mode::probe_rtt) {
+        return minCwnd;
+    }
+    if (bw_.rate() == 0 || min_rtt_ == 0) {
+        return initialCwnd;
+    }
+    // KCP's window spans from the first unacknowledged segment, so it has
+    // to cover a lost one being sent again as well as the round trip
+    auto span = std::max(double(min_rtt_), double(round_us_) / 1000);
+    auto cwnd = cwnd_gain_ * bw_.rate() * span / double(segment_);
+    return std::max(uint32_t(cwnd), minCwnd);
+}
+
+std::unique_ptr<Congestion> CoupledGroup::join(std::size_t segment) {
+    return std::unique_ptr<Congestion>(
+            new Coupled(shared_from_this(), segment));
+}
+
+double CoupledGroup::alpha() const {
+    double total = 0, best = 0, sum = 0;
+    for (auto m : members_) {
+        if (m->srtt_ == 0) {
+            continue;
+        }
+        double rtt = m->srtt_;
+        total += m->cwnd_;
+        best = std::max(best, m->cwnd_ / (rtt * rtt));
+        sum += m->cwnd_ / rtt;
+    }
+    return sum == 0 ? 1 : total * best / (sum * sum);
+}
+
+double CoupledGroup::total() const {
+    double total = 0;
+    for (auto m : members_) {
+        total += m->cwnd_;
+    }
+    return total;
+}
+
+Coupled::Coupled(std::shared_ptr<CoupledGroup> group, std::size_t segment)
+    : group_(group), segment_(segment), cwnd_(initialCwnd),
+      ssthresh_(FLAGS_sndwnd) {
+    group_->members_.push_back(this);
+}
+
+Coupled::~Coupled() {
+    auto &members = group_->members_;
+    members.erase(std::remove(members.begin(), members.end(), this),
+                  members.end());
+}
+
+void Coupled::on_ack(uint64_t now_us, uint32_t una, uint32_t nxt,
+                     uint32_t delivered, uint32_t srtt_ms, bool app_limited) {
+    srtt_ = srtt_ms;
+    nxt_ = nxt;
+    if (recovering_ && diff(una, recover_) >= 0) {
+        recovering_ = false;
+    }
+    auto acked = delivered - delivered_;
+    delivered_ = delivered;
+    // a window the sender does not fill says nothing about the path
+    if (acked == 0 || app_limited || recovering_) {
+        return;
+    }
+    if (cwnd_ < ssthresh_) {
+        cwnd_ = std::min(cwnd_ + acked, ssthresh_);
+    } else {
+        cwnd_ += acked * std::min(group_->alpha() / group_->total(),
+                                  1 / cwnd_);
+    }
+    cwnd_ = std::min(cwnd_, double(FLAGS_sndwnd));
+}
+
+void Coupled::on_loss(uint64_t now_us, uint32_t sn) {
+    if (recovering_ && diff(sn, recover_) < 0) {
+        return;
+    }
+    recovering_ = true;
+    recover_ = nxt_;
+    cwnd_ = std::max(cwnd_ / 2, double(minCwnd));
+    ssthresh_ = cwnd_;
+}
+
+double Coupled::pacing_rate() const {
+    if (srtt_ == 0) {
+        return 0;
+    }
+    // ahead of the window a little, twice as far while it doubles
+    auto gain = cwnd_ < ssthresh_ ? 2 : 1.25;
+    return gain * cwnd_ * segment_ / srtt_;
+}
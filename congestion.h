@@ -0,0 +1,148 @@
+#ifndef KCPTUN_CONGESTION_H
+#define KCPTUN_CONGESTION_H
+
+#include "pacer.h"
+
+// Congestion decides how many segments a session may have in flight and
+// how fast it sends them. The controllers, chosen with --cc:
+//
+//   kcp   KCP's own loss based window (nc 0)
+//   none  nothing but the send window (nc 1)
+//   bbr   a model of the path's bandwidth and round trip, see Bbr
+//
+// kcp and none leave the window to KCP and pace at twice the delivery
+// rate. Only the sender's side matters, the peers need not agree. The
+// sessions of a client may share a CoupledGroup instead, see Coupled.
+class Congestion {
+public:
+    // New creates the controller called 'name', none for anything unknown.
+    // A full segment takes 'segment' bytes on the wire.
+    static std::unique_ptr<Congestion> New(const std::string &name,
+                                           std::size_t segment);
+
+    virtual ~Congestion() = default;
+
+    // on_ack is called on each update of the session. 'una' is the first
+    // sequence number not yet acknowledged and 'nxt' the next one to be
+    // sent, 'delivered' counts the segments acknowledged so far, each
+    // once, and 'srtt_ms' is 0 before the first ack. 'app_limited' is true
+    // while the sender neither fills its window nor has data waiting for
+    // room in it.
+    virtual void on_ack(uint64_t now_us, uint32_t una, uint32_t nxt,
+                        uint32_t delivered, uint32_t srtt_ms,
+                        bool app_limited) = 0;
+    // on_loss is called for each segment sent again.
+    virtual void on_loss(uint64_t now_us, uint32_t sn) = 0;
+    // In bytes per ms, 0 to send unpaced.
+    virtual double pacing_rate() const = 0;
+    // In segments, 0 to leave the window to KCP.
+    virtual uint32_t cwnd() const = 0;
+    // Whether the session must pace for the controller to work, with or
+    // without --pace.
+    virtual bool needs_pacing() const { return false; }
+    // Whether KCP's own loss based window limits as well (nc 0).
+    virtual bool kcp_window() const { return false; }
+};
+
+// Bbr keeps the session's data in flight near the path's bandwidth-delay
+// product instead of backing off on loss, which on a lossy but idle link
+// is mostly not congestion. The bandwidth is the largest delivery rate of
+// the last ten round trips and the round trip the smallest smoothed one
+// of the last ten seconds. It goes through BBR's states:
+//
+//   startup    pace at 2/ln2 of the bandwidth until it stops growing
+//   drain      pace below it until the queue startup built is gone
+//   probe_bw   cycle 5/4, 3/4, then six round trips at the bandwidth
+//   probe_rtt  hold 4 segments in flight for 200 ms when the round trip
+//              has not been seen lower for ten seconds
+class Bbr final : public Congestion {
+public:
+    explicit Bbr(std::size_t segment);
+
+    void on_ack(uint64_t now_us, uint32_t una, uint32_t nxt,
+                uint32_t delivered, uint32_t srtt_ms, bool app_limited) override;
+    void on_loss(uint64_t now_us, uint32_t sn) override {}
+    double pacing_rate() const override;
+    uint32_t cwnd() const override;
+    bool needs_pacing() const override { return true; }
+
+private:
+    enum class Mode { startup, drain, probe_bw, probe_rtt };
+
+    double bdp() const; // in segments
+    void check_full_bw();
+    void enter_probe_bw(uint64_t now_us);
+    void leave_probe_rtt(uint64_t now_us);
+
+    std::size_t segment_;
+    DeliveryRate bw_;
+    Mode mode_ = Mode::startup;
+    double pacing_gain_;
+    double cwnd_gain_;
+    uint32_t inflight_ = 0;
+    uint32_t min_rtt_ = 0;
+    uint64_t min_rtt_us_ = 0; // when min_rtt_ was seen
+    uint32_t round_end_ = 0;
+    bool round_start_ = false;
+    uint64_t round_at_us_ = 0; // when the round trip began
+    uint64_t round_us_ = 0;    // how long the last one took
+    double full_bw_ = 0;
+    int full_bw_rounds_ = 0;
+    bool filled_ = false;
+    int cycle_ = 0;
+    uint64_t cycle_us_ = 0;
+    uint64_t probe_rtt_done_us_ = 0;
+};
+
+class Coupled;
+
+// CoupledGroup ties together the sessions a client runs to one server
+// with --conn, so that together they take no more of the path than a
+// single flow would (--coupled).
+class CoupledGroup final : public std::enable_shared_from_this<CoupledGroup> {
+public:
+    // join creates the controller of one more session in the group.
+    std::unique_ptr<Congestion> join(std::size_t segment);
+
+private:
+    friend class Coupled;
+
+    // alpha is LIA's aggressiveness, the share of a single flow's increase
+    // the group takes per round trip of its best path.
+    double alpha() const;
+    double total() const; // the windows of all, in segments
+
+    std::vector<Coupled *> members_;
+};
+
+// Coupled is Reno with the Linked Increases of multipath TCP (RFC 6356):
+// a session grows its window by at most alpha over the group's combined
+// window per segment acknowledged, and by no more than a lone flow would,
+// so the group as a whole is as fair as one flow. It halves its own
+// window at most once a round trip on loss.
+class Coupled final : public Congestion {
+public:
+    Coupled(std::shared_ptr<CoupledGroup> group, std::size_t segment);
+    ~Coupled() override;
+
+    void on_ack(uint64_t now_us, uint32_t una, uint32_t nxt,
+                uint32_t delivered, uint32_t srtt_ms, bool app_limited) override;
+    void on_loss(uint64_t now_us, uint32_t sn) override;
+    double pacing_rate() const override;
+    uint32_t cwnd() const override { return uint32_t(cwnd_); }
+
+private:
+    friend class CoupledGroup;
+
+    std::shared_ptr<CoupledGroup> group_;
+    std::size_t segment_;
+    double cwnd_;
+    double ssthresh_;
+    uint32_t srtt_ = 0;
+    uint32_t nxt_ = 0;
+    uint32_t delivered_ = 0;
+    uint32_t recover_ = 0; // losses below are of the window already cut
+    bool recovering_ = false;
+};
+
+#endif
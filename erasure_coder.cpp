@@ -0,0 +1,18 @@
+#include "erasure_coder.h"
+#include "cauchy.h"
+#include "reedsolomon.h"
+
+std::shared_ptr<ErasureCoder> newErasureCoder(codecType type, int dataShards,
+                                              int parityShards) {
+    switch (type) {
+    case codecType::xorParity:
+        return std::make_shared<ReedSolomon>(
+            ReedSolomon::New(dataShards, parityShards, true));
+    case codecType::cauchy:
+        return std::make_shared<CauchyCoder>(
+            CauchyCoder::New(dataShards, parityShards));
+    default:
+        return std::make_shared<ReedSolomon>(
+            ReedSolomon::New(dataShards, parityShards));
+    }
+}
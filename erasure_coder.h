@@ -0,0 +1,42 @@
+#ifndef KCP_ERASURE_CODER_H
+#define KCP_ERASURE_CODER_H
+
+#include "matrix.h"
+#include <memory>
+#include <vector>
+
+// ErasureCoder is the interface shared by the erasure code engines. Shards
+// are passed as data shards followed by parity shards, missing ones nil.
+class ErasureCoder {
+public:
+    virtual ~ErasureCoder() = default;
+
+    // Encode computes the parity shards from the data shards.
+    virtual void Encode(std::vector<row_type> &shards) = 0;
+
+    // Reconstruct recreates all the missing shards, if possible.
+    virtual void Reconstruct(std::vector<row_type> &shards) = 0;
+
+    // ReconstructData recreates only the missing data shards.
+    virtual void ReconstructData(std::vector<row_type> &shards) = 0;
+
+    // ReconstructData decodes missing data shard i into dst[i] instead of
+    // allocating it.
+    virtual void ReconstructData(std::vector<row_type> &shards,
+                                 std::vector<byte *> &dst) = 0;
+
+    // ShardAlignment is the multiple of bytes the shard size must be.
+    virtual int ShardAlignment() const { return 1; }
+};
+
+enum class codecType {
+    reedSolomon, // table driven Reed-Solomon over GF(2^8)
+    xorParity,   // plain xor, a single parity shard
+    cauchy,      // Cauchy bit-matrix with xor schedules
+};
+
+// newErasureCoder creates an engine of the given type for the shape.
+std::shared_ptr<ErasureCoder> newErasureCoder(codecType type, int dataShards,
+                                              int parityShards);
+
+#endif // KCP_ERASURE_CODER_H
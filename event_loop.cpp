@@ -0,0 +1,46 @@
+#include "event_loop.h"
+
+asio::io_service::id EventLoop::id;
+
+void EventLoop::run() {
+    running_ = true;
+    loop_clock.enabled = true;
+    for (;;) {
+        loop_clock.valid = false;
+        auto n = service_.run_one();
+        if (n > 0) {
+            service_.poll();
+        }
+        if (!run_deferred() && n == 0) {
+            break;
+        }
+        if (service_.stopped()) {
+            // out of work, but the deferred work may have posted more
+            service_.reset();
+        }
+    }
+    running_ = false;
+    loop_clock.enabled = false;
+    loop_clock.valid = false;
+}
+
+void EventLoop::defer(std::function<void()> f) {
+    if (!running_) {
+        service_.post(f);
+        return;
+    }
+    deferred_.push_back(std::move(f));
+}
+
+bool EventLoop::run_deferred() {
+    // deferred work may defer more, which must not wait for the next event
+    auto ran = !deferred_.empty();
+    while (!deferred_.empty()) {
+        std::vector<std::function<void()>> deferred;
+        deferred.swap(deferred_);
+        for (auto &f : deferred) {
+            f();
+        }
+    }
+    return ran;
+}
@@ -0,0 +1,39 @@
+#ifndef KCPTUN_EVENT_LOOP_H
+#define KCPTUN_EVENT_LOOP_H
+
+#include "utils.h"
+
+// EventLoop runs an io_service in iterations: wait for one handler, run
+// all others that are ready, then the work deferred during the iteration.
+// Objects that would otherwise act on every event in a burst defer it
+// here and act once per iteration instead. The clock is read once per
+// iteration too, by the first handler that asks for it.
+class EventLoop final : public asio::io_service::service {
+public:
+    static asio::io_service::id id;
+
+    explicit EventLoop(asio::io_service &service)
+        : asio::io_service::service(service), service_(service) {}
+
+    static EventLoop &of(asio::io_service &service) {
+        return asio::use_service<EventLoop>(service);
+    }
+
+    // Runs the io_service until it is out of work and nothing is deferred,
+    // in place of run().
+    void run();
+
+    // Calls f at the end of the current iteration. Without run(), f is
+    // posted to the io_service instead.
+    void defer(std::function<void()> f);
+
+private:
+    void shutdown_service() { deferred_.clear(); }
+    bool run_deferred(); // false if there was nothing to run
+
+    asio::io_service &service_;
+    bool running_ = false;
+    std::vector<std::function<void()>> deferred_;
+};
+
+#endif
@@ -26,6 +26,7 @@
 
 #include "fec.h"
 #include "encoding.h"
+#include <algorithm>
 //#include <err.h>
 #include <iostream>
 #include <stdexcept>
@@ -37,24 +38,27 @@ static inline uint32_t currentMs() {
     return uint32_t((sec * 1000) + (usec / 1000));
 }
 
-FEC::FEC(ReedSolomon enc) : enc(enc) {}
+FEC::FEC(std::shared_ptr<ErasureCoder> enc) : enc(enc) {}
 
-FEC FEC::New(int rxlimit, int dataShards, int parityShards) {
-    if (dataShards <= 0 || parityShards <= 0) {
+FEC FEC::New(int rxlimit, int dataShards, int parityShards,
+             codecType codec, int interleave) {
+    if (dataShards <= 0 || parityShards <= 0 || interleave <= 0) {
         throw std::invalid_argument("invalid arguments");
     }
 
-    if (rxlimit < dataShards + parityShards) {
+    if (rxlimit < (dataShards + parityShards) * interleave) {
         throw std::invalid_argument("invalid arguments");
     }
 
-    FEC fec(ReedSolomon::New(dataShards, parityShards));
+    FEC fec(newErasureCoder(codec, dataShards, parityShards));
     fec.rxlimit = rxlimit;
     fec.dataShards = dataShards;
     fec.parityShards = parityShards;
     fec.totalShards = dataShards + parityShards;
-    fec.paws = (0xffffffff / uint32_t(fec.totalShards) - 1) *
-               uint32_t(fec.totalShards);
+    fec.interleave = interleave;
+    // open groups never straddle the wrap
+    auto span = uint32_t(fec.totalShards) * uint32_t(interleave);
+    fec.paws = (0xffffffff / span - 1) * span;
 
     return fec;
 }
@@ -70,18 +74,27 @@ fecPacket FEC::Decode(byte *data, size_t sz) {
 }
 
 void FEC::MarkData(byte *data, uint16_t sz) {
-    data = encode32u(data, this->next);
+    auto group = uint32_t(dataPos % interleave);
+    auto idx = uint32_t(dataPos / interleave);
+    data = encode32u(data, this->next + group * totalShards + idx);
     data = encode16u(data, typeData);
     encode16u(data, static_cast<uint16_t>(sz + 2)); // including size itself
-    this->next++;
+    this->dataPos++;
 }
 
 void FEC::MarkFEC(byte *data) {
-    data = encode32u(data, this->next);
+    auto group = uint32_t(parityPos % interleave);
+    auto idx = uint32_t(dataShards + parityPos / interleave);
+    data = encode32u(data, this->next + group * totalShards + idx);
     encode16u(data, typeFEC);
-    this->next++;
-    if (this->next >= this->paws) { // paws would only occurs in MarkFEC
-        this->next = 0;
+    this->parityPos++;
+    if (this->parityPos == parityShards * interleave) {
+        this->next += uint32_t(totalShards * interleave);
+        this->dataPos = 0;
+        this->parityPos = 0;
+        if (this->next >= this->paws) { // paws would only occurs in MarkFEC
+            this->next = 0;
+        }
     }
 }
 
@@ -92,6 +105,7 @@ std::vector<row_type> FEC::Input(fecPacket &pkt) {
     if (now - lastCheck >= fecExpire) {
         for (auto it = rx.begin(); it != rx.end();) {
             if (now - it->ts > fecExpire) {
+                finish(it->seqid);
                 it = rx.erase(it);
             } else {
                 it++;
@@ -100,6 +114,13 @@ std::vector<row_type> FEC::Input(fecPacket &pkt) {
         lastCheck = now;
     }
 
+    // newest seqid seen, allowing for the wrap at paws
+    if (!started || (pkt.seqid > newest && pkt.seqid - newest < paws / 2) ||
+        (pkt.seqid < newest && newest - pkt.seqid > paws / 2)) {
+        started = true;
+        newest = pkt.seqid;
+    }
+
     // insertion
     auto n = this->rx.size() - 1;
     int insertIdx = 0;
@@ -113,6 +134,21 @@ std::vector<row_type> FEC::Input(fecPacket &pkt) {
     }
     // insert into ordered rx queue
     rx.insert(rx.begin() + insertIdx, pkt);
+    auto g = track(pkt.seqid);
+    if (g != nullptr && !g->done) {
+        auto idx = pkt.seqid % totalShards;
+        if (pkt.flag == typeFEC && g->asked == 1 &&
+            g->expect <= uint32_t(dataShards)) {
+            // the first parity answering a single request
+            auto rtt = now - g->askedAt;
+            nackRtt = nackRtt == 0 ? rtt : (7 * nackRtt + rtt) / 8;
+        }
+        g->numshard++;
+        if (idx < uint32_t(dataShards)) {
+            g->numdata++;
+        }
+        g->expect = std::max(g->expect, idx + 1);
+    }
 
     // shard range for current packet
     auto shardBegin = pkt.seqid - pkt.seqid % totalShards;
@@ -159,34 +195,164 @@ std::vector<row_type> FEC::Input(fecPacket &pkt) {
         }
 
         if (numDataShard == dataShards) { // no lost
+            finish(shardBegin);
             rx.erase(rx.begin() + first, rx.begin() + first + numshard);
         } else if (numshard >= dataShards) { // recoverable
-            // equally resized
+            // equally resized, to the size the engine codes in
+            auto align = size_t(enc->ShardAlignment());
+            maxlen = (maxlen + align - 1) / align * align;
             for (int i = 0; i < shardVec.size(); i++) {
                 if (shardVec[i] != nullptr) {
                     shardVec[i]->resize(maxlen, 0);
                 }
             }
 
-            // reconstruct shards
-            enc.Reconstruct(shardVec);
+            // reconstruct the missing data shards, parity is not needed
+            enc->ReconstructData(shardVec);
             for (int k = 0; k < dataShards; k++) {
                 if (!shardflag[k]) {
                     recovered.push_back(shardVec[k]);
                 }
             }
+            finish(shardBegin);
             rx.erase(rx.begin() + first, rx.begin() + first + numshard);
         }
     }
 
     // keep rxlimit
     if (rx.size() > rxlimit) {
+        finish(rx.begin()->seqid);
         rx.erase(rx.begin());
     }
 
     return recovered;
 }
 
+// track returns the group seqid belongs to, adding the ones up to it, or
+// nullptr for a group older than those kept.
+fecGroup *FEC::track(uint32_t seqid) {
+    auto begin = seqid - seqid % totalShards;
+    auto limit = size_t(rxlimit / totalShards);
+    if (!groups.empty()) {
+        auto first = groups.front().begin;
+        if (begin < first) {
+            if (seqid != newest) {
+                return nullptr;
+            }
+            groups.clear(); // wrapped at paws
+            awaiting = 0;
+        } else if ((begin - first) / totalShards >= groups.size() + limit) {
+            groups.clear(); // none of those kept would remain
+            awaiting = 0;
+        }
+    }
+    if (groups.empty()) {
+        groups.emplace_back(begin);
+    }
+    while (groups.back().begin < begin) {
+        groups.emplace_back(groups.back().begin + totalShards);
+    }
+    while (groups.size() > limit) {
+        if (groups.front().asked > 0 && !groups.front().done) {
+            awaiting--;
+        }
+        groups.pop_front();
+    }
+    return &groups[(begin - groups.front().begin) / totalShards];
+}
+
+void FEC::finish(uint32_t seqid) {
+    auto begin = seqid - seqid % totalShards;
+    if (groups.empty() || begin < groups.front().begin) {
+        return;
+    }
+    auto i = (begin - groups.front().begin) / totalShards;
+    if (i >= groups.size() || groups[i].done) {
+        return;
+    }
+    groups[i].done = true;
+    if (groups[i].asked > 0) {
+        awaiting--;
+    }
+}
+
+uint32_t FEC::nackRetry() const {
+    return nackRtt == 0 ? nackRetryFirst : nackRtt + nackRtt / 2 + 1;
+}
+
+bool FEC::RecoveryPending() const {
+    if (awaiting > 0 && currentMs() - lastNack < nackRetry()) {
+        return true;
+    }
+    // only the open groups still have shards on the way, and parity only
+    // if the sender sends it unasked
+    auto span = uint32_t(totalShards * interleave);
+    auto open = newest - newest % span;
+    auto last = nack ? dataShards : totalShards;
+    for (auto g = groups.rbegin(); g != groups.rend() && g->begin >= open; ++g) {
+        // a data shard was passed over
+        bool gap = g->numdata < std::min(int(g->expect), dataShards);
+        auto coming = last - int(g->expect);
+        if (!g->done && gap && g->numshard + coming >= dataShards) {
+            return true;
+        }
+    }
+    return false;
+}
+
+size_t FEC::NackDue(byte *buf) {
+    // groups before the ones the sender has open are complete on its side
+    auto span = uint32_t(totalShards * interleave);
+    auto open = newest - newest % span;
+    auto now = currentMs();
+    if (open == nackedUpTo && (awaiting == 0 || int32_t(now - nextNack) < 0)) {
+        return 0;
+    }
+    nackedUpTo = open;
+    auto retry = nackRetry();
+    nextNack = now + retry;
+
+    // groups none of whose shards came are tracked as well, see track
+    byte *p = buf + fecHeaderSizePlus2;
+    int count = 0;
+    for (auto &g : groups) {
+        if (g.begin >= open) {
+            break;
+        }
+        if (count == maxNackEntries) {
+            nextNack = now; // the rest with the next packet
+            break;
+        }
+        auto wanted = dataShards - g.numshard;
+        if (g.done || wanted <= 0 || wanted > parityShards) {
+            continue;
+        }
+        if (g.asked > 0 && now - g.askedAt < retry) {
+            if (int32_t(g.askedAt + retry - nextNack) < 0) {
+                nextNack = g.askedAt + retry;
+            }
+            continue;
+        }
+        if (g.asked == 0) {
+            awaiting++;
+        }
+        g.asked++;
+        g.askedAt = now;
+        p = encode32u(p, g.begin);
+        *p++ = byte(wanted);
+        count++;
+    }
+    if (count == 0) {
+        return 0;
+    }
+    lastNack = now;
+
+    byte *h = encode32u(buf, 0);
+    h = encode16u(h, typeNack);
+    encode16u(h, uint16_t(count));
+    return p - buf;
+}
+
 void FEC::Encode(std::vector<row_type> &shards) {
     // resize elements with 0 appending
     size_t max = 0;
@@ -195,6 +361,8 @@ void FEC::Encode(std::vector<row_type> &shards) {
             max = shards[i]->size();
         }
     }
+    auto align = size_t(enc->ShardAlignment());
+    max = (max + align - 1) / align * align;
 
     for (auto &s : shards) {
         if (s == nullptr) {
@@ -204,5 +372,5 @@ void FEC::Encode(std::vector<row_type> &shards) {
         }
     }
 
-    enc.Encode(shards);
+    enc->Encode(shards);
 }
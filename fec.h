@@ -27,7 +27,8 @@
 #ifndef KCP_FEC_H
 #define KCP_FEC_H
 
-#include "reedsolomon.h"
+#include "erasure_coder.h"
+#include <deque>
 #include <memory>
 #include <stdint.h>
 #include <vector>
@@ -36,7 +37,16 @@ const size_t fecHeaderSize = 6;
 const size_t fecHeaderSizePlus2{fecHeaderSize + 2};
 const uint16_t typeData = 0xf1;
 const uint16_t typeFEC = 0xf2;
+const uint16_t typeRepair = 0xf3; // sliding window repair, see sliding_fec.h
+const uint16_t typeRepairSymbol = 0xf4; // fountain repair, see fountain_fec.h
+const uint16_t typeFeedback = 0xf5;     // fountain loss report
+const uint16_t typeUnprotected = 0xf6;  // data outside any group, seqid 0
+const uint16_t typeNack = 0xf7;         // parity request, see FEC::NackDue
+const size_t nackEntrySize = 5;         // group seqid(4) + shards wanted(1)
+const int maxNackEntries = 32;
+const size_t maxNackSize = fecHeaderSizePlus2 + nackEntrySize * maxNackEntries;
 const int fecExpire = 30000;
+const uint32_t nackRetryFirst = 200; // ms, before a round trip is measured
 
 class fecPacket {
 public:
@@ -46,12 +56,37 @@ public:
     uint32_t ts;
 };
 
+// fecGroup is what the receiver knows of one group, kept as shards come
+// in so that questions about the recent groups need no walk of rx.
+struct fecGroup {
+    explicit fecGroup(uint32_t begin) : begin(begin) {}
+
+    uint32_t begin;      // first seqid
+    int numshard{0};     // shards received
+    int numdata{0};      // of them data shards
+    uint32_t expect{0};  // past the highest shard index received
+    bool done{false};    // complete, recovered or given up
+    int asked{0};        // times its parity was asked for
+    uint32_t askedAt{0}; // when last
+};
+
 class FEC {
 public:
     FEC() = default;
-    FEC(ReedSolomon enc);
-
-    static FEC New(int rxlimit, int dataShards, int parityShards);
+    FEC(std::shared_ptr<ErasureCoder> enc);
+
+    // New creates a FEC codec on the given erasure code engine. The xor
+    // parity engine is only valid with a single parity shard.
+    //
+    // With interleave > 1 the sender keeps that many groups open at once:
+    // consecutive data packets go round-robin across them, and the parity
+    // of all of them follows the last one. A burst of up to
+    // interleave * parityShards lost packets is then recoverable. Each
+    // group still owns a contiguous seqid range, so the receiver needs
+    // nothing but an rxlimit large enough for all open groups.
+    static FEC New(int rxlimit, int dataShards, int parityShards,
+                   codecType codec = codecType::reedSolomon,
+                   int interleave = 1);
 
     inline bool isEnabled() { return dataShards > 0 && parityShards > 0; }
 
@@ -64,22 +99,61 @@ public:
     // Decode a raw array into fecPacket
     static fecPacket Decode(byte *data, size_t sz);
 
+    // RecoveryPending reports whether an open group misses data shards but
+    // can still be reconstructed from shards yet to come, or parity asked
+    // for with NackDue is still expected. Segments in such a group are
+    // likely to show up shortly without a retransmission.
+    bool RecoveryPending() const;
+
+    // SetNack tells the receiver the sender keeps its parity until asked
+    // for it, see NackDue, so none is on the way unasked.
+    void SetNack(bool on) { nack = on; }
+
+    // NackDue writes a typeNack packet into buf, at least maxNackSize long,
+    // for the groups the sender has moved past that still miss shards
+    // parity can make up for, and returns its length, or 0 if there is
+    // nothing to ask for. After the seqid and flag comes the count(2),
+    // then per group its first seqid(4) and the number of parity shards
+    // that would repair it(1). A group is asked for again each round trip
+    // and a half while it stays incomplete, the round trip being the time
+    // its parity takes to come when asked for once.
+    size_t NackDue(byte *buf);
+
     // Mark raw array as typeData, and write correct size.
     void MarkData(byte *data, uint16_t sz);
 
-    // Mark raw array as typeFEC
+    // Mark raw array as typeFEC. Once all data of the open groups is
+    // marked, it is called parityShards times per group, taking parity
+    // shard i of every group in turn before shard i+1.
     void MarkFEC(byte *data);
 
 private:
+    fecGroup *track(uint32_t seqid);
+    void finish(uint32_t seqid);
+    uint32_t nackRetry() const;
+
     std::vector<fecPacket> rx; // ordered receive queue
+    std::deque<fecGroup> groups; // the recent groups in order, at most
+                                 // rxlimit / totalShards of them
     int rxlimit;               // queue empty limit
     int dataShards;
     int parityShards;
     int totalShards;
-    uint32_t next{0}; // next seqid
-    ReedSolomon enc;
+    int interleave{1};
+    uint32_t next{0}; // first seqid of the open groups
+    int dataPos{0};   // data packets marked in the open groups
+    int parityPos{0}; // parity packets marked in the open groups
+    std::shared_ptr<ErasureCoder> enc;
     uint32_t paws; // Protect Against Wrapped Sequence numbers
     uint32_t lastCheck{0};
+    bool started{false};
+    uint32_t newest{0};     // newest seqid received
+    uint32_t nackedUpTo{0}; // groups before this seqid were looked at
+    bool nack{false};
+    int awaiting{0};        // groups asked for and not done
+    uint32_t lastNack{0};   // when a group was last asked for
+    uint32_t nextNack{0};   // when one is due to be asked for again
+    uint32_t nackRtt{0};    // smoothed, in ms
 };
 
 #endif // KCP_FEC_H
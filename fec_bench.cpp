@@ -0,0 +1,111 @@
+// fec_bench compares the erasure code engines on the usual shard shapes.
+//
+//   fec_bench [shard size] [seconds per case]
+//
+// Encode and decode rates are counted in data bytes. Decoding loses as
+// many data shards as there are parity shards, the worst case.
+
+#include "erasure_coder.h"
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct shape {
+    int dataShards;
+    int parityShards;
+};
+
+static const shape shapes[] = {{10, 3}, {20, 10}, {5, 5}, {70, 30}};
+
+struct engine {
+    const char *name;
+    codecType type;
+};
+
+static const engine engines[] = {{"rs", codecType::reedSolomon},
+                                 {"cauchy", codecType::cauchy}};
+
+static double now() {
+    return std::chrono::duration<double>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+static std::vector<row_type> newShards(int dataShards, int parityShards,
+                                       std::size_t shardSize) {
+    std::vector<row_type> shards(dataShards + parityShards);
+    for (int i = 0; i < dataShards + parityShards; i++) {
+        shards[i] = std::make_shared<std::vector<byte>>(shardSize);
+        if (i < dataShards) {
+            for (auto &b : *shards[i]) {
+                b = byte(rand());
+            }
+        }
+    }
+    return shards;
+}
+
+// Runs f until 'seconds' have passed and returns MB/s of 'bytes' per call.
+template <typename F> static double rate(F f, double seconds, double bytes) {
+    long n = 0;
+    double begin = now();
+    double end;
+    do {
+        f();
+        n++;
+        end = now();
+    } while (end - begin < seconds);
+    return bytes * n / (end - begin) / 1e6;
+}
+
+int main(int argc, char **argv) {
+    std::size_t shardSize = argc > 1 ? atoi(argv[1]) : 1344;
+    double seconds = argc > 2 ? atof(argv[2]) : 0.5;
+    if (shardSize == 0 || shardSize % 8 != 0) {
+        fprintf(stderr, "shard size must be a positive multiple of 8\n");
+        return 1;
+    }
+
+    printf("%-8s %-8s %12s %12s\n", "shape", "engine", "encode MB/s",
+           "decode MB/s");
+    for (auto &s : shapes) {
+        for (auto &e : engines) {
+            auto coder = newErasureCoder(e.type, s.dataShards, s.parityShards);
+            auto shards = newShards(s.dataShards, s.parityShards, shardSize);
+            double bytes = double(shardSize) * s.dataShards;
+
+            double enc = rate([&] { coder->Encode(shards); }, seconds, bytes);
+
+            // Check the worst case decode before timing it.
+            std::vector<row_type> lost(shards);
+            for (int i = 0; i < s.parityShards; i++) {
+                lost[i] = nullptr;
+            }
+            coder->ReconstructData(lost);
+            for (int i = 0; i < s.dataShards; i++) {
+                if (*lost[i] != *shards[i]) {
+                    fprintf(stderr, "%s (%d,%d): shard %d decoded wrong\n",
+                            e.name, s.dataShards, s.parityShards, i);
+                    return 1;
+                }
+            }
+
+            std::vector<byte *> dst(s.dataShards);
+            std::vector<std::vector<byte>> out(
+                s.parityShards, std::vector<byte>(shardSize));
+            for (int i = 0; i < s.parityShards; i++) {
+                lost[i] = nullptr;
+                dst[i] = out[i].data();
+            }
+            double dec = rate([&] { coder->ReconstructData(lost, dst); },
+                              seconds, bytes);
+
+            char name[16];
+            snprintf(name, sizeof(name), "%d+%d", s.dataShards,
+                     s.parityShards);
+            printf("%-8s %-8s %12.0f %12.0f\n", name, e.name, enc, dec);
+        }
+    }
+    return 0;
+}
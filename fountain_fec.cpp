@@ -0,0 +1,236 @@
+#include "fountain_fec.h"
+#include "encoding.h"
+#include "galois_noasm.h"
+#include "sliding_fec.h"
+#include <algorithm>
+#include <math.h>
+#include <stdexcept>
+#include <string.h>
+
+static const uint32_t blockMask = 0xffffff;
+
+fountainEncoder fountainEncoder::New(int k, int repairs) {
+    if (k <= 0 || k > 254 || repairs <= 0) {
+        throw std::invalid_argument("invalid arguments");
+    }
+
+    fountainEncoder enc;
+    enc.k = k;
+    enc.repairs = std::min(repairs, 255 - k);
+    enc.sources.resize(k);
+    enc.coef.resize(k);
+    return enc;
+}
+
+void fountainEncoder::MarkData(byte *data, uint16_t sz) {
+    if (count == k) {
+        block = (block + 1) & blockMask;
+        count = 0;
+        esi = 0;
+    }
+
+    data = encode32u(data, (block << 8) | uint32_t(esi));
+    data = encode16u(data, typeData);
+    encode16u(data, static_cast<uint16_t>(sz - fecHeaderSize));
+    sources[count].assign(data, data + sz - fecHeaderSize);
+    count++;
+    esi++;
+}
+
+int fountainEncoder::RepairsDue() const {
+    return count == k ? repairs - (esi - k) : 0;
+}
+
+size_t fountainEncoder::EncodeRepair(byte *buf) {
+    size_t len = 0;
+    for (auto &s : sources) {
+        len = std::max(len, s.size());
+    }
+
+    uint32_t seqid = (block << 8) | uint32_t(esi);
+    byte *p = encode32u(buf, seqid);
+    p = encode16u(p, typeRepairSymbol);
+    memset(p, 0, len);
+    repairCoefficients(seqid, k, coef.data());
+    for (int i = 0; i < k; i++) {
+        galMulSliceXorRaw(coef[i], sources[i].data(), p, sources[i].size());
+    }
+    esi++;
+    return fecHeaderSize + len;
+}
+
+void fountainEncoder::Feedback(uint16_t report) {
+    double p = std::min(report / 65535.0, 0.9);
+    loss = 0.75 * loss + 0.25 * p;
+
+    // Send the fewest repair symbols for which at least k of the block
+    // arrive with three standard deviations to spare, and at least one.
+    int r = 1;
+    for (; r < 255 - k; r++) {
+        double n = k + r;
+        double mean = n * (1 - loss);
+        if (mean - 3 * sqrt(n * loss * (1 - loss)) >= k) {
+            break;
+        }
+    }
+    repairs = r;
+}
+
+fountainDecoder fountainDecoder::New(int k) {
+    if (k <= 0 || k > 254) {
+        throw std::invalid_argument("invalid arguments");
+    }
+
+    fountainDecoder dec;
+    dec.k = k;
+    dec.row.resize(k);
+    return dec;
+}
+
+std::vector<row_type> fountainDecoder::Input(fecPacket &pkt) {
+    std::vector<row_type> recovered;
+    uint32_t id = pkt.seqid >> 8;
+    int esi = int(pkt.seqid & 0xff);
+    if ((pkt.flag == typeData) != (esi < k)) {
+        return recovered;
+    }
+
+    if (!started) {
+        started = true;
+        newest = id;
+    }
+    // Block numbers are compared as signed 24-bit differences.
+    int32_t diff = int32_t((id - newest) << 8) >> 8;
+    if (diff <= -maxBlocks) {
+        return recovered;
+    }
+    if (diff > 0) {
+        newest = id;
+    }
+
+    auto &b = blocks[id % maxBlocks];
+    if (b.used && b.block != id) {
+        retire(b);
+    }
+    if (!b.used) {
+        b.used = true;
+        b.block = id;
+        b.source.assign(k, false);
+        b.pivotRow.assign(k, -1);
+    }
+    b.received++;
+    b.maxEsi = std::max(b.maxEsi, esi);
+    if (b.done) {
+        return recovered;
+    }
+
+    // Reduce the new row against the pivots found so far.
+    std::vector<byte> data(*pkt.data);
+    if (esi < k) {
+        if (b.source[esi]) {
+            b.received--;
+            return recovered;
+        }
+        b.source[esi] = true;
+        std::fill(row.begin(), row.end(), 0);
+        row[esi] = 1;
+    } else {
+        repairCoefficients(pkt.seqid, k, row.data());
+    }
+
+    for (int c = 0; c < k; c++) {
+        byte f = row[c];
+        if (f == 0) {
+            continue;
+        }
+        int r = b.pivotRow[c];
+        if (r >= 0) {
+            auto &pc = b.coef[r];
+            for (int i = c; i < k; i++) {
+                row[i] ^= galMultiply(f, pc[i]);
+            }
+            auto &pd = b.data[r];
+            if (data.size() < pd.size()) {
+                data.resize(pd.size(), 0);
+            }
+            galMulSliceXorRaw(f, pd.data(), data.data(), pd.size());
+            continue;
+        }
+
+        // A new pivot, kept with coefficient 1.
+        if (f != 1) {
+            byte inv = galDivide(1, f);
+            galMulSliceRaw(inv, row.data() + c, row.data() + c, k - c);
+            galMulSliceRaw(inv, data.data(), data.data(), data.size());
+        }
+        b.pivotRow[c] = int(b.coef.size());
+        b.coef.push_back(row);
+        b.data.push_back(std::move(data));
+        b.rank++;
+        break;
+    }
+
+    if (b.rank == k) {
+        decode(b, recovered);
+    }
+    return recovered;
+}
+
+void fountainDecoder::decode(blockState &b, std::vector<row_type> &recovered) {
+    // Back substitution, last column first. Row pivotRow[c] only has
+    // columns from c on, and the later ones are solved already.
+    for (int c = k - 1; c >= 0; c--) {
+        int r = b.pivotRow[c];
+        auto &coef = b.coef[r];
+        auto &data = b.data[r];
+        for (int i = c + 1; i < k; i++) {
+            if (coef[i] == 0) {
+                continue;
+            }
+            auto &src = b.data[b.pivotRow[i]];
+            if (data.size() < src.size()) {
+                data.resize(src.size(), 0);
+            }
+            galMulSliceXorRaw(coef[i], src.data(), data.data(), src.size());
+        }
+        if (!b.source[c]) {
+            recovered.push_back(std::make_shared<std::vector<byte>>(data));
+        }
+    }
+
+    b.done = true;
+    b.coef.clear();
+    b.data.clear();
+}
+
+void fountainDecoder::retire(blockState &b) {
+    // Symbols lost after the last one seen are not noticed, so the loss
+    // reported is a lower bound.
+    sent += std::max(b.maxEsi + 1, k);
+    received += b.received;
+    retired++;
+
+    b.used = false;
+    b.done = false;
+    b.received = 0;
+    b.maxEsi = -1;
+    b.rank = 0;
+    b.coef.clear();
+    b.data.clear();
+}
+
+bool fountainDecoder::FeedbackDue(byte *buf) {
+    if (retired < blocksPerFeedback) {
+        return false;
+    }
+
+    double loss = sent > received ? double(sent - received) / sent : 0;
+    retired = 0;
+    sent = 0;
+    received = 0;
+
+    byte *p = encode32u(buf, 0);
+    p = encode16u(p, typeFeedback);
+    encode16u(p, uint16_t(loss * 65535));
+    return true;
+}
@@ -0,0 +1,106 @@
+#ifndef KCP_FOUNTAIN_FEC_H
+#define KCP_FOUNTAIN_FEC_H
+
+#include "fec.h"
+#include <stdint.h>
+#include <vector>
+
+// Rateless FEC. Source packets are cut into blocks of k symbols and sent
+// unchanged as typeData packets; each block is followed by as many repair
+// symbols as the receiver's loss reports ask for, every one a random
+// linear combination over GF(2^8) of the k sources. Any k linearly
+// independent symbols of a block decode it, which with random
+// coefficients over GF(2^8) is almost always exactly k of them.
+//
+// The seqid of every symbol is (block << 8) | esi, where the encoding
+// symbol id esi is below k for sources and k or more for repairs. The
+// repair coefficients are seeded by the seqid, as in sliding_fec.h.
+//
+// Feedback packet: seqid(4) typeFeedback(2) loss(2)
+//
+// loss is the fraction of symbols lost in 1/65535.
+const size_t feedbackSize = fecHeaderSize + 2;
+
+class fountainEncoder {
+public:
+    fountainEncoder() = default;
+
+    // New creates an encoder for blocks of k source symbols sending
+    // 'repairs' repair symbols per block until feedback says otherwise.
+    static fountainEncoder New(int k, int repairs);
+
+    // MarkData writes the header of the source packet of sz bytes in data
+    // and keeps its symbol for the repair symbols of its block.
+    void MarkData(byte *data, uint16_t sz);
+
+    // RepairsDue returns the number of repair symbols to send now.
+    int RepairsDue() const;
+
+    // EncodeRepair writes the next repair symbol of the block just
+    // completed into buf and returns its size.
+    size_t EncodeRepair(byte *buf);
+
+    // Feedback sets the repair rate from the loss the peer reported.
+    void Feedback(uint16_t loss);
+
+    int Repairs() const { return repairs; }
+
+private:
+    int k{0};
+    int repairs{0};
+    int count{0};   // sources of the current block so far
+    int esi{0};     // next esi of the current block
+    uint32_t block{0};
+    double loss{0}; // smoothed reported loss
+    std::vector<std::vector<byte>> sources;
+    std::vector<byte> coef;
+};
+
+class fountainDecoder {
+public:
+    fountainDecoder() = default;
+
+    // New creates a decoder for blocks of k source symbols.
+    static fountainDecoder New(int k);
+
+    // Input a source or repair symbol, and return the source symbols it
+    // made recoverable.
+    std::vector<row_type> Input(fecPacket &pkt);
+
+    // FeedbackDue returns true once a loss report should be sent, and
+    // writes it into buf.
+    bool FeedbackDue(byte *buf);
+
+private:
+    enum { maxBlocks = 8, blocksPerFeedback = 16 };
+
+    struct blockState {
+        bool used{false};
+        bool done{false};
+        uint32_t block{0};
+        int received{0};
+        int maxEsi{-1};
+        int rank{0};
+        std::vector<bool> source;       // source esi received
+        std::vector<int> pivotRow;      // row having column c as pivot, or -1
+        std::vector<std::vector<byte>> coef;
+        std::vector<std::vector<byte>> data;
+    };
+
+    void retire(blockState &b);
+    void decode(blockState &b, std::vector<row_type> &recovered);
+
+    int k{0};
+    bool started{false};
+    uint32_t newest{0};
+    blockState blocks[maxBlocks];
+    std::vector<byte> row; // scratch coefficients
+
+    // Symbols sent and received over the blocks retired since the last
+    // loss report.
+    int retired{0};
+    uint64_t sent{0};
+    uint64_t received{0};
+};
+
+#endif // KCP_FOUNTAIN_FEC_H
@@ -26,17 +26,59 @@
 
 #include "galois_noasm.h"
 #include "matrix.h"
+#include <stdint.h>
+#include <string.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
 
 extern "C" byte mulTable[256][256];
 
 void galMulSlice(byte c, row_type in, row_type out) {
-    for (int n = 0; n < in->size(); n++) {
-        (*out)[n] = mulTable[c][(*in)[n]];
-    }
+    galMulSliceRaw(c, in->data(), out->data(), in->size());
 }
 
 void galMulSliceXor(byte c, row_type in, row_type out) {
-    for (int n = 0; n < in->size(); n++) {
-        (*out)[n] ^= mulTable[c][(*in)[n]];
+    galMulSliceXorRaw(c, in->data(), out->data(), in->size());
+}
+
+void galMulSliceRaw(byte c, const byte *in, byte *out, size_t n) {
+    const byte *mt = mulTable[c];
+    for (size_t i = 0; i < n; i++) {
+        out[i] = mt[in[i]];
+    }
+}
+
+void galMulSliceXorRaw(byte c, const byte *in, byte *out, size_t n) {
+    const byte *mt = mulTable[c];
+    for (size_t i = 0; i < n; i++) {
+        out[i] ^= mt[in[i]];
+    }
+}
+
+void galXorSlice(const byte *in, byte *out, size_t n) {
+    size_t i = 0;
+#if defined(__SSE2__)
+    for (; i + 16 <= n; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(in + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(out + i));
+        _mm_storeu_si128((__m128i *)(out + i), _mm_xor_si128(a, b));
+    }
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    for (; i + 16 <= n; i += 16) {
+        vst1q_u8(out + i, veorq_u8(vld1q_u8(in + i), vld1q_u8(out + i)));
+    }
+#endif
+    for (; i + 8 <= n; i += 8) {
+        uint64_t a, b;
+        memcpy(&a, in + i, 8);
+        memcpy(&b, out + i, 8);
+        b ^= a;
+        memcpy(out + i, &b, 8);
+    }
+    for (; i < n; i++) {
+        out[i] ^= in[i];
     }
 }
@@ -36,6 +36,13 @@ extern "C" {
 void galMulSlice(byte c, row_type in, row_type out);
 void galMulSliceXor(byte c, row_type in, row_type out);
 
+// Same as above on raw buffers of n bytes.
+void galMulSliceRaw(byte c, const byte *in, byte *out, size_t n);
+void galMulSliceXorRaw(byte c, const byte *in, byte *out, size_t n);
+
+// galXorSlice xors n bytes of in into out, a vector at a time.
+void galXorSlice(const byte *in, byte *out, size_t n);
+
 #ifdef __cplusplus
 }
 #endif
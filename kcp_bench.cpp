@@ -0,0 +1,180 @@
+// kcp_bench runs a bulk transfer between two KCP cores over a simulated
+// long fat link, for each pairing of sender and receiver core and each
+// window size. The mixed pairings check the cores understand each other.
+//
+//   kcp_bench [loss percent] [mtu] [segments per case]
+//
+// The link delays every datagram 50 ms each way and drops the given share
+// of the data path. Both ends use --sndwnd and --rcvwnd of the window
+// tried, in fast mode. Reported is the time the two cores take per data
+// segment delivered, the simulated link left out; the virtual clock runs
+// free of it. Every byte in flight is copied into and out of the cores,
+// so once a window of payload outgrows the caches, at a full mtu, those
+// copies miss and cost more. A small mtu measures the protocol alone.
+
+#include "kcp_core.h"
+#include <chrono>
+#include <deque>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+// sender and receiver
+static const char *pairs[][2] = {
+    {"ikcp", "ikcp"}, {"ring", "ring"}, {"ikcp", "ring"}, {"ring", "ikcp"}};
+static const int windows[] = {32, 128, 512, 2048, 8192};
+static const uint32_t delay = 50;
+
+struct datagram {
+    uint32_t due;
+    std::string data;
+};
+
+class path {
+public:
+    explicit path(double loss) : loss_(loss) {}
+    void send(uint32_t now, const char *buf, std::size_t len) {
+        seed_ = seed_ * 6364136223846793005ULL + 1442695040888963407ULL;
+        if (double(seed_ >> 11) / double(1ULL << 53) < loss_) {
+            return;
+        }
+        datagram d;
+        if (!spare_.empty()) {
+            d = std::move(spare_.back());
+            spare_.pop_back();
+        }
+        d.due = now + delay;
+        d.data.assign(buf, len);
+        q_.push_back(std::move(d));
+    }
+    bool ready(uint32_t now) const {
+        return !q_.empty() && int32_t(now - q_.front().due) >= 0;
+    }
+    // pop copies the first datagram out to 'buf', as reading a socket
+    // would, and returns its length.
+    std::size_t pop(char *buf) {
+        auto &d = q_.front();
+        auto len = d.data.size();
+        memcpy(buf, d.data.data(), len);
+        spare_.push_back(std::move(d));
+        q_.pop_front();
+        return len;
+    }
+
+private:
+    double loss_;
+    uint64_t seed_ = 1;
+    std::deque<datagram> q_;
+    std::vector<datagram> spare_;
+};
+
+static double now() {
+    return std::chrono::duration<double>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+// Returns the ns per segment delivered, or a negative value if the
+// received stream came out wrong.
+static double run(const char *from, const char *to, int wnd, double loss,
+                  std::size_t mtu, long segments) {
+    auto segSize = mtu - 24;
+    path forward(loss);
+    path back(0);
+    uint32_t t = 0;
+    double link = 0; // seconds spent in the simulated link
+    auto sender = KCPCore::New(from, 1, [&](const char *buf, std::size_t len) {
+        auto begin = now();
+        forward.send(t, buf, len);
+        link += now() - begin;
+    });
+    auto receiver = KCPCore::New(to, 1, [&](const char *buf, std::size_t len) {
+        auto begin = now();
+        back.send(t, buf, len);
+        link += now() - begin;
+    });
+    for (auto core : {sender.get(), receiver.get()}) {
+        core->set_stream(true);
+        core->nodelay(1, 10, 2, 1);
+        core->wndsize(wnd, wnd);
+        core->setmtu(int(mtu));
+    }
+
+    // byte i of the stream is i % 251, so any slip shows at a segment edge
+    std::string pattern(segSize + 251, 0);
+    for (std::size_t i = 0; i < pattern.size(); i++) {
+        pattern[i] = char(i % 251);
+    }
+    std::vector<char> rx(mtu);
+    auto buf = rx.data();
+    uint64_t sent = 0;
+    uint64_t received = 0;
+    long delivered = 0;
+    auto begin = now();
+    while (delivered < segments) {
+        t++;
+        while (sender->waitsnd() < 2 * wnd) {
+            sender->send(pattern.data() + sent % 251, segSize);
+            sent += segSize;
+        }
+        sender->update(t);
+        while (back.ready(t)) {
+            auto begin = now();
+            auto len = back.pop(buf);
+            link += now() - begin;
+            sender->input(buf, len);
+        }
+        while (forward.ready(t)) {
+            auto begin = now();
+            auto len = forward.pop(buf);
+            link += now() - begin;
+            receiver->input(buf, len);
+        }
+        const char *data;
+        std::size_t len;
+        while (receiver->front(&data, &len)) {
+            if (data[0] != char(received % 251) ||
+                data[len - 1] != char((received + len - 1) % 251)) {
+                return -1;
+            }
+            received += len;
+            receiver->pop_front();
+            delivered++;
+        }
+        receiver->update(t);
+    }
+    return (now() - begin - link) * 1e9 / double(delivered);
+}
+
+int main(int argc, char **argv) {
+    double loss = (argc > 1 ? atof(argv[1]) : 1) / 100;
+    std::size_t mtu = argc > 2 ? atoi(argv[2]) : 1350;
+    long segments = argc > 3 ? atol(argv[3]) : 200000;
+    if (mtu < 50) {
+        fprintf(stderr, "mtu must be at least 50\n");
+        return 1;
+    }
+
+    printf("%-8s", "window");
+    for (auto &pair : pairs) {
+        printf(" %10s>%s", pair[0], pair[1]);
+    }
+    printf("   ns per segment\n");
+    for (auto wnd : windows) {
+        printf("%-8d", wnd);
+        for (auto &pair : pairs) {
+            auto ns = run(pair[0], pair[1], wnd, loss, mtu, segments);
+            if (ns < 0) {
+                fprintf(stderr, "\n%s>%s: stream corrupted at window %d\n",
+                        pair[0], pair[1], wnd);
+                return 1;
+            }
+            printf(" %15.0f", ns);
+            fflush(stdout);
+        }
+        printf("\n");
+    }
+    return 0;
+}
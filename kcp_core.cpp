@@ -0,0 +1,100 @@
+#include "kcp_core.h"
+#include "ikcp.h"
+#include "ring_kcp.h"
+
+namespace {
+
+class IKCPCore : public KCPCore {
+public:
+    IKCPCore(uint32_t conv, Output output) : output_(output) {
+        kcp_ = ikcp_create(conv, static_cast<void *>(this));
+        kcp_->output = IKCPCore::output_wrapper;
+    }
+
+    ~IKCPCore() override { ikcp_release(kcp_); }
+
+    void set_stream(bool stream) override { kcp_->stream = stream ? 1 : 0; }
+
+    void nodelay(int nodelay, int interval, int resend, int nc) override {
+        ikcp_nodelay(kcp_, nodelay, interval, resend, nc);
+    }
+
+    void wndsize(int sndwnd, int rcvwnd) override {
+        ikcp_wndsize(kcp_, sndwnd, rcvwnd);
+    }
+
+    void setmtu(int mtu) override { ikcp_setmtu(kcp_, mtu); }
+
+    int input(const char *data, std::size_t size) override {
+        // input only ever takes segments out of the send buffer
+        auto before = kcp_->nsnd_buf;
+        auto ret = ikcp_input(kcp_, data, long(size));
+        delivered_ += before - kcp_->nsnd_buf;
+        return ret;
+    }
+
+    int send(const char *buffer, std::size_t len) override {
+        return ikcp_send(kcp_, buffer, int(len));
+    }
+
+    int peeksize() const override { return ikcp_peeksize(kcp_); }
+
+    bool front(const char **data, std::size_t *len) const override {
+        if (ikcp_peeksize(kcp_) <= 0) {
+            return false;
+        }
+        auto seg = iqueue_entry(kcp_->rcv_queue.next, IKCPSEG, node);
+        *data = seg->data;
+        *len = seg->len;
+        return true;
+    }
+
+    void pop_front() override {
+        if (iqueue_is_empty(&kcp_->rcv_queue)) {
+            return;
+        }
+        auto seg = iqueue_entry(kcp_->rcv_queue.next, IKCPSEG, node);
+        // a null buffer drops the segment without copying it
+        ikcp_recv(kcp_, nullptr, int(seg->len));
+    }
+
+    int waitsnd() const override { return ikcp_waitsnd(kcp_); }
+
+    uint32_t rcv_nxt() const override { return kcp_->rcv_nxt; }
+
+    uint32_t snd_una() const override { return kcp_->snd_una; }
+
+    uint32_t srtt() const override { return uint32_t(kcp_->rx_srtt); }
+
+    uint32_t delivered() const override { return delivered_; }
+
+    void update(uint32_t current) override { ikcp_update(kcp_, current); }
+
+    uint32_t check(uint32_t current) const override {
+        return ikcp_check(kcp_, current);
+    }
+
+    void flush() override { ikcp_flush(kcp_); }
+
+private:
+    static int output_wrapper(const char *buffer, int len, struct IKCPCB *kcp,
+                              void *user) {
+        auto core = static_cast<IKCPCore *>(user);
+        core->output_(buffer, static_cast<std::size_t>(len));
+        return 0;
+    }
+
+    ikcpcb *kcp_ = nullptr;
+    Output output_;
+    uint32_t delivered_ = 0;
+};
+
+} // namespace
+
+std::unique_ptr<KCPCore> KCPCore::New(const std::string &name, uint32_t conv,
+                                      Output output) {
+    if (name == "ring") {
+        return std::unique_ptr<KCPCore>(new RingKCP(conv, output));
+    }
+    return std::unique_ptr<KCPCore>(new IKCPCore(conv, output));
+}
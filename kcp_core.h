@@ -0,0 +1,57 @@
+#ifndef KCPTUN_KCP_CORE_H
+#define KCPTUN_KCP_CORE_H
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <stdint.h>
+#include <string>
+
+// KCPCore is the part of KCP a Session drives. The cores speak the same
+// wire protocol, so either side may run either one:
+//
+//   ikcp  the reference implementation, segments on linked lists
+//   ring  segments in arrays indexed by sequence number, see ring_kcp.h
+//
+// The calls mirror their ikcp_* namesakes.
+class KCPCore {
+public:
+    using Output = std::function<void(const char *, std::size_t)>;
+
+    // New creates the core called 'name', ikcp for anything unknown.
+    // Datagrams to send are handed to 'output'.
+    static std::unique_ptr<KCPCore> New(const std::string &name, uint32_t conv,
+                                        Output output);
+
+    virtual ~KCPCore() = default;
+
+    virtual void set_stream(bool stream) = 0;
+    virtual void nodelay(int nodelay, int interval, int resend, int nc) = 0;
+    virtual void wndsize(int sndwnd, int rcvwnd) = 0;
+    virtual void setmtu(int mtu) = 0;
+
+    virtual int input(const char *data, std::size_t size) = 0;
+    virtual int send(const char *buffer, std::size_t len) = 0;
+    virtual int peeksize() const = 0;
+    // front points 'data' at the first segment of the receive queue, in
+    // place. It is false while there is no message to receive.
+    virtual bool front(const char **data, std::size_t *len) const = 0;
+    // pop_front drops the segment front returned.
+    virtual void pop_front() = 0;
+    virtual int waitsnd() const = 0;
+    // rcv_nxt is the first sequence number not yet received in order.
+    virtual uint32_t rcv_nxt() const = 0;
+    // snd_una is the first sequence number not yet acknowledged.
+    virtual uint32_t snd_una() const = 0;
+    // srtt is the smoothed round trip time in ms, 0 before the first ack.
+    virtual uint32_t srtt() const = 0;
+    // delivered counts the segments acknowledged so far, each once as it
+    // leaves the send buffer, by its own ack or by a later una.
+    virtual uint32_t delivered() const = 0;
+
+    virtual void update(uint32_t current) = 0;
+    virtual uint32_t check(uint32_t current) const = 0;
+    virtual void flush() = 0;
+};
+
+#endif
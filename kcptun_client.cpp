@@ -8,9 +8,12 @@ kcptun_client::kcptun_client(asio::io_service &io_service,
       target_endpoint_(target_endpoint), acceptor_(io_service, local_endpoint){}
 
 void kcptun_client::run() {
+    if (FLAGS_coupled) {
+        group_ = std::make_shared<CoupledGroup>();
+    }
     locals_.reserve(FLAGS_conn);
     for (int i = 0; i < FLAGS_conn; i++) {
-        auto l = std::make_shared<Local>(service_, target_endpoint_);
+        auto l = std::make_shared<Local>(service_, target_endpoint_, group_);
         l->run();
         locals_.emplace_back(l);
     }
@@ -23,7 +26,7 @@ void kcptun_client::async_choose_local(
     auto i = rand() % FLAGS_conn;
     auto local = locals_[i].lock();
     if ((!local) || local->is_destroyed()) {
-        local = std::make_shared<Local>(service_, target_endpoint_);
+        local = std::make_shared<Local>(service_, target_endpoint_, group_);
         local->run();
         locals_[i] = local;
         f(local);
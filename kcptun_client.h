@@ -49,6 +49,7 @@ private:
     asio::ip::udp::endpoint target_endpoint_;
     asio::ip::tcp::acceptor acceptor_;
     std::vector<std::weak_ptr<Local>> locals_;
+    std::shared_ptr<CoupledGroup> group_; // with --coupled
 };
 
 #endif
@@ -1,5 +1,7 @@
 #include "kcptun_server.h"
+#include "async_fec.h"
 #include "fec.h"
+#include "kernel_pacing.h"
 #include "server.h"
 #include "sess.h"
 #include "smux.h"
@@ -13,6 +15,8 @@ kcptun_server::kcptun_server(asio::io_service &io_service,
 void kcptun_server::run() {
     isfec_ = FLAGS_datashard > 0 && FLAGS_parityshard > 0;
     dec_or_enc_ = getDecEncrypter(FLAGS_crypt, pbkdf2(FLAGS_key));
+    // one socket for all clients, so pace by datagram, not by socket
+    txtime_ = kernel_pacing_txtime() && enable_socket_txtime(usocket_);
     do_receive();
 }
 
@@ -46,7 +50,7 @@ void kcptun_server::do_receive() {
                 if (isfec_) {
                     uint16_t fec_type;
                     decode16u((byte *)(buf + 4), &fec_type);
-                    if (fec_type != typeData) {
+                    if (fec_type != typeData && fec_type != typeUnprotected) {
                         do_receive();
                         return;
                     }
@@ -55,8 +59,14 @@ void kcptun_server::do_receive() {
                     decode32u((byte *)buf, &convid);
                 }
                 asio::ip::udp::endpoint ep = ep_;
+                std::shared_ptr<TxClock> txclock;
+                // sends of the session gone the async way and not yet done
+                auto queued = std::make_shared<std::size_t>(0);
+                if (txtime_) {
+                    txclock = std::make_shared<TxClock>();
+                }
                 server = std::make_shared<Server>(
-                        service_, [this, self, ep](char *buf, std::size_t len,
+                        service_, [this, self, ep, txclock, queued](char *buf, std::size_t len,
                                                    Handler handler) {
                             char *buffer = buffers_.get();
                             memcpy(buffer + nonce_size + crc_size, buf, len);
@@ -65,10 +75,28 @@ void kcptun_server::do_receive() {
                             dec_or_enc_->encrypt(
                                     buffer, len + nonce_size + crc_size, buffer,
                                     len + nonce_size + crc_size);
+                            auto n = len + nonce_size + crc_size;
+                            auto ack = txclock && (isfec_ ? fec_ack_only(buf, len)
+                                                          : kcp_ack_only(buf, len));
+                            // nothing may overtake a datagram still queued
+                            if (txclock && *queued == 0 &&
+                                send_with_txtime(usocket_, ep, buffer, n,
+                                                 ack ? txclock->depart_ack()
+                                                     : txclock->depart(n))) {
+                                buffers_.push_back(buffer);
+                                service_.post([handler, len] {
+                                    if (handler) {
+                                        handler(std::error_code(0, std::generic_category()), len);
+                                    }
+                                });
+                                return;
+                            }
+                            ++*queued;
                             usocket_.async_send_to(
                                     asio::buffer(buffer, len + nonce_size + crc_size),
-                                    ep, [handler, this, self, len,
-                                            buffer](std::error_code ec, std::size_t) {
+                                    ep, [handler, this, self, len, buffer,
+                                            queued](std::error_code ec, std::size_t) {
+                                        --*queued;
                                         buffers_.push_back(buffer);
                                         if (handler) {
                                             handler(ec, len);
@@ -80,6 +108,11 @@ void kcptun_server::do_receive() {
                             accept_handler(sess);
                         },
                         convid);
+                if (txclock) {
+                    server->set_pacing_handler([txclock](double rate) {
+                        txclock->set_rate(rate);
+                    });
+                }
                 servers_.emplace(ep, server);
             }
             server->async_input(
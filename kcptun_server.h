@@ -41,6 +41,7 @@ private:
 
 private:
     bool isfec_;
+    bool txtime_ = false; // departure times for the kernel to pace by
     char buf_[2048];
     asio::io_service &service_;
     asio::ip::udp::socket usocket_;
@@ -1,11 +1,18 @@
+#include "async_fec.h"
 #include "encrypt.h"
+#include "event_loop.h"
+#include "kernel_pacing.h"
 #include "kcptun_server.h"
 #include "local.h"
 #include "server.h"
+#include "slab.h"
 
 int main(int argc, char **argv) {
     gflags::SetUsageMessage("usage: kcptun_server");
     parse_command_lines(argc, argv);
+    precompute_fec_matrices();
+    install_kcp_allocator();
+    probe_kernel_pacing();
     asio::io_service io_service;
     asio::ip::udp::endpoint local_endpoint;
     asio::ip::tcp::endpoint target_endpoint;
@@ -24,7 +31,7 @@ int main(int argc, char **argv) {
     if (FLAGS_kvar) {
         run_kvar_printer(io_service);
     }
-    io_service.run();
+    EventLoop::of(io_service).run();
     gflags::ShutDownCommandLineFlags();
     google::ShutdownGoogleLogging();
     return 0;
@@ -0,0 +1,136 @@
+#include "kernel_pacing.h"
+#include "config.h"
+
+#ifdef __linux__
+#include <linux/net_tstamp.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+static bool pacing_rate_ok = false;
+static bool txtime_ok = false;
+
+#ifdef __linux__
+
+static bool fq_default_qdisc() {
+    std::ifstream ifs("/proc/sys/net/core/default_qdisc");
+    std::string qdisc;
+    ifs >> qdisc;
+    return qdisc == "fq";
+}
+
+static bool probe_option(int level, int name, const void *val,
+                         socklen_t len) {
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0) {
+        return false;
+    }
+    bool ok = setsockopt(fd, level, name, val, len) == 0;
+    close(fd);
+    return ok;
+}
+
+void probe_kernel_pacing() {
+    if (!FLAGS_kernelpace) {
+        return;
+    }
+    // fq takes both options but is the only qdisc to honour them
+    if (!fq_default_qdisc()) {
+        LOG(WARNING) << "kernelpace: default qdisc is not fq, pacing in userspace";
+        return;
+    }
+    unsigned int rate = ~0U;
+    pacing_rate_ok = probe_option(SOL_SOCKET, SO_MAX_PACING_RATE, &rate,
+                                  sizeof(rate));
+#ifdef SO_TXTIME
+    struct sock_txtime txtime = {CLOCK_MONOTONIC, 0};
+    txtime_ok = probe_option(SOL_SOCKET, SO_TXTIME, &txtime, sizeof(txtime));
+#endif
+    LOG(INFO) << "kernelpace: SO_MAX_PACING_RATE "
+              << (pacing_rate_ok ? "on" : "unsupported") << ", SO_TXTIME "
+              << (txtime_ok ? "on" : "unsupported");
+}
+
+void set_socket_pacing_rate(asio::ip::udp::socket &s, double rate) {
+    // bytes per second, all ones for no limit
+    unsigned int bps = ~0U;
+    if (rate > 0 && rate * 1000 < double(~0U)) {
+        bps = unsigned(rate * 1000);
+    }
+    setsockopt(s.native_handle(), SOL_SOCKET, SO_MAX_PACING_RATE, &bps,
+               sizeof(bps));
+}
+
+bool enable_socket_txtime(asio::ip::udp::socket &s) {
+#ifdef SO_TXTIME
+    struct sock_txtime txtime = {CLOCK_MONOTONIC, 0};
+    return setsockopt(s.native_handle(), SOL_SOCKET, SO_TXTIME, &txtime,
+                      sizeof(txtime)) == 0;
+#else
+    return false;
+#endif
+}
+
+bool send_with_txtime(asio::ip::udp::socket &s,
+                      const asio::ip::udp::endpoint &ep, const char *buf,
+                      std::size_t len, uint64_t txtime_ns) {
+#ifdef SO_TXTIME
+    struct iovec iov;
+    iov.iov_base = (void *)buf;
+    iov.iov_len = len;
+    char control[CMSG_SPACE(sizeof(uint64_t))] = {};
+    struct msghdr msg = {};
+    msg.msg_name = (void *)ep.data();
+    msg.msg_namelen = socklen_t(ep.size());
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    struct cmsghdr *cm = CMSG_FIRSTHDR(&msg);
+    cm->cmsg_level = SOL_SOCKET;
+    cm->cmsg_type = SCM_TXTIME;
+    cm->cmsg_len = CMSG_LEN(sizeof(uint64_t));
+    memcpy(CMSG_DATA(cm), &txtime_ns, sizeof(uint64_t));
+    return sendmsg(s.native_handle(), &msg, MSG_DONTWAIT) == ssize_t(len);
+#else
+    return false;
+#endif
+}
+
+#else
+
+void probe_kernel_pacing() {
+    if (FLAGS_kernelpace) {
+        LOG(WARNING) << "kernelpace: needs Linux, pacing in userspace";
+    }
+}
+
+void set_socket_pacing_rate(asio::ip::udp::socket &s, double rate) {}
+
+bool enable_socket_txtime(asio::ip::udp::socket &s) { return false; }
+
+bool send_with_txtime(asio::ip::udp::socket &s,
+                      const asio::ip::udp::endpoint &ep, const char *buf,
+                      std::size_t len, uint64_t txtime_ns) {
+    return false;
+}
+
+#endif
+
+bool kernel_pacing_rate() { return pacing_rate_ok; }
+
+bool kernel_pacing_txtime() { return txtime_ok; }
+
+uint64_t TxClock::depart(std::size_t len) {
+    auto now = current_monotonic_usec() * 1000;
+    if (rate_ <= 0) {
+        next_ns_ = now;
+        return now;
+    }
+    // the credit of a quiet spell is --paceburst datagrams
+    auto burst = uint64_t(double(FLAGS_paceburst) * FLAGS_mtu / rate_ * 1e6);
+    auto at = std::max(next_ns_, now > burst ? now - burst : 0);
+    next_ns_ = at + uint64_t(double(len) / rate_ * 1e6);
+    return std::max(at, now);
+}
@@ -0,0 +1,49 @@
+#ifndef KCPTUN_KERNEL_PACING_H
+#define KCPTUN_KERNEL_PACING_H
+
+#include "utils.h"
+
+// With --kernelpace the fq qdisc spaces datagrams out in place of the
+// userspace Pacer, with no timer wakeups of our own:
+//
+//   rate    SO_MAX_PACING_RATE on a socket of one session, the client's
+//   txtime  an SO_TXTIME departure time on each datagram, for a socket
+//           shared by many sessions, the server's
+//
+// probe_kernel_pacing finds out once at startup which of them work here:
+// they need Linux, fq as the default qdisc and the socket option. Sessions
+// whose socket cannot be paced by the kernel fall back to the Pacer.
+void probe_kernel_pacing();
+bool kernel_pacing_rate();
+bool kernel_pacing_txtime();
+
+// Sets the rate fq paces 's' at, in bytes per ms, 0 for no limit.
+void set_socket_pacing_rate(asio::ip::udp::socket &s, double rate);
+
+// Lets 's' carry departure times, false if it is refused.
+bool enable_socket_txtime(asio::ip::udp::socket &s);
+
+// TxClock hands out departure times, CLOCK_MONOTONIC in ns, for the
+// datagrams of one session on a txtime socket. Up to --paceburst of them
+// may leave at once after a quiet spell.
+class TxClock final {
+public:
+    // In bytes per ms, 0 to send everything at once.
+    void set_rate(double rate) { rate_ = rate; }
+    uint64_t depart(std::size_t len);
+    // Acks leave at once, ahead of the paced data and taking nothing from
+    // its rate, as late ones would inflate the peer's rtt.
+    uint64_t depart_ack() const { return current_monotonic_usec() * 1000; }
+
+private:
+    double rate_ = 0;
+    uint64_t next_ns_ = 0;
+};
+
+// Sends a datagram from 's' to 'ep' to leave at 'txtime_ns', without
+// blocking. False if it could not go right away.
+bool send_with_txtime(asio::ip::udp::socket &s,
+                      const asio::ip::udp::endpoint &ep, const char *buf,
+                      std::size_t len, uint64_t txtime_ns);
+
+#endif
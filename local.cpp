@@ -1,13 +1,15 @@
 #include "local.h"
 #include "async_fec.h"
+#include "kernel_pacing.h"
 #include "sess.h"
 #include "smux.h"
 #include "snappy_stream.h"
 
 static kvar local_kvar("Local");
 
-Local::Local(asio::io_service &io_service, asio::ip::udp::endpoint ep)
-    : service_(io_service), ep_(ep), kvar_(local_kvar) {
+Local::Local(asio::io_service &io_service, asio::ip::udp::endpoint ep,
+             std::shared_ptr<CoupledGroup> group)
+    : service_(io_service), ep_(ep), group_(group), kvar_(local_kvar) {
     auto usocket = asio::ip::udp::socket(io_service);
     usocket.connect(ep_);
     usock_ = std::make_shared<UsocketReadWriter>(std::move(usocket));
@@ -20,8 +22,9 @@ void Local::run() {
     in = [this](char *buf, std::size_t len, Handler handler) {
         sess_->async_input(buf, len, handler);
     };
+    std::shared_ptr<AsyncInOutputer> fec_in;
     if (fec) {
-        auto fec_in = std::make_shared<AsyncFECInputer>(in);
+        fec_in = make_fec_inputer(service_, in);
         in = [this, fec_in](char *buf, std::size_t len, Handler handler) {
             fec_in->async_input(buf, len, handler);
         };
@@ -60,13 +63,32 @@ void Local::run() {
         });
     };
     if (fec) {
-        auto fec_out = std::make_shared<AsyncFECOutputer>(out);
+        auto fec_out = make_fec_outputer(service_, out);
+        link_fec_stages(fec_in, fec_out, out);
         out = [this, fec_out](char *buf, std::size_t len, Handler handler) {
             fec_out->async_input(buf, len, handler);
         };
     }
     sess_ = std::make_shared<Session>(service_, uint32_t(rand()), out);
+    if (group_) {
+        sess_->set_congestion(group_->join(std::size_t(FLAGS_mtu)));
+    }
     sess_->run();
+    if (fec) {
+        sess_->set_recovery_hint(fec_recovery_hint(fec_in));
+    }
+    if (kernel_pacing_rate()) {
+        sess_->set_pacing_handler([this](double rate) {
+            // a setsockopt per update is not worth small changes
+            if (!usock_ || rate == pacing_rate_ ||
+                (rate > 0 && pacing_rate_ > 0 &&
+                 std::abs(rate - pacing_rate_) < pacing_rate_ / 8)) {
+                return;
+            }
+            pacing_rate_ = rate;
+            set_socket_pacing_rate(usock_->socket(), rate);
+        });
+    }
 
     out2 = [this](char *buf, std::size_t len, Handler handler) {
         sess_->async_write(buf, len, handler);
@@ -80,6 +102,18 @@ void Local::run() {
         };
     }
     smux_ = std::make_shared<smux>(service_, out2);
+    smux_->set_flush_handler([this] {
+        if (sess_) {
+            sess_->flush_soon();
+        }
+    });
+    if (FLAGS_nocomp) {
+        // compression joins frames into its own buffer anyway
+        smux_->set_writev_handler([this](const Slice *slices, std::size_t n,
+                                         Handler handler) {
+            sess_->async_writev(slices, n, handler);
+        });
+    }
     smux_->call_on_destroy([self, this]{
         destroy();
     });
@@ -119,18 +153,21 @@ void Local::do_usocket_receive() {
 
 void Local::do_sess_receive() {
     auto self = shared_from_this();
-    sess_->async_read_some(
-        sbuf_, sizeof(sbuf_), [this, self](std::error_code ec, std::size_t sz) {
+    auto sess = sess_;
+    sess->async_read_view([this, self, sess](std::error_code ec,
+                                             const char *data, std::size_t sz) {
+        if (ec) {
+            return;
+        }
+        in2((char *)data, sz, [this, self, sess, sz](std::error_code ec,
+                                                     std::size_t) {
             if (ec) {
                 return;
             }
-            in2(sbuf_, sz, [this, self](std::error_code ec, std::size_t) {
-                if (ec) {
-                    return;
-                }
-                do_sess_receive();
-            });
+            sess->consume_view(sz);
+            do_sess_receive();
         });
+    });
 }
 
 void Local::async_connect(
@@ -145,13 +182,12 @@ void Local::run_scavenger() {
         return;
     }
     auto self = shared_from_this();
-    auto timer = std::make_shared<asio::high_resolution_timer>(
-        service_, std::chrono::seconds(FLAGS_scavengettl));
-    timer->async_wait([this, timer, self](const std::error_code &) {
-        if (smux_) {
-            smux_->destroy();
-        }
-    });
+    TimingWheel::of(service_).arm(
+        scavenger_timer_, uint32_t(FLAGS_scavengettl * 1000), [this, self] {
+            if (smux_) {
+                smux_->destroy();
+            }
+        });
 }
 
 void Local::call_this_on_destroy() {
@@ -159,6 +195,8 @@ void Local::call_this_on_destroy() {
 
     Destroy::call_this_on_destroy();
 
+    scavenger_timer_.cancel();
+
     if (sess_) {
         auto sess = sess_;
         sess_ = nullptr;
@@ -2,6 +2,7 @@
 #define KCPTUN_LOCAL_H
 
 #include "config.h"
+#include "congestion.h"
 #include "sess.h"
 
 class smux_sess;
@@ -12,7 +13,9 @@ class Local final :
         public kvar_,
         public Destroy {
 public:
-    Local(asio::io_service &io_service, asio::ip::udp::endpoint ep);
+    // With a 'group' the session's window is coupled to the others in it.
+    Local(asio::io_service &io_service, asio::ip::udp::endpoint ep,
+          std::shared_ptr<CoupledGroup> group);
     void run();
     void async_connect(std::function<void(std::shared_ptr<smux_sess>)> handler);
     void run_scavenger();
@@ -24,17 +27,19 @@ private:
 
 private:
     char buf_[2048];
-    char sbuf_[2048];
     asio::io_service &service_;
     asio::ip::udp::endpoint ep_;
+    std::shared_ptr<CoupledGroup> group_;
     std::shared_ptr<Session> sess_;
     std::shared_ptr<smux> smux_;
-    std::shared_ptr<AsyncReadWriter> usock_;
+    std::shared_ptr<UsocketReadWriter> usock_;
     OutputHandler in;
     OutputHandler out;
     OutputHandler in2;
     OutputHandler out2;
     Buffers buffers_;
+    TimerNode scavenger_timer_;
+    double pacing_rate_ = 0; // last set on usock_, 0 for none
 };
 
 #endif
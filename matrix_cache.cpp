@@ -0,0 +1,160 @@
+#include "matrix_cache.h"
+#include <stdexcept>
+#include <string.h>
+
+matrixCache matrixCache::newMatrixCache(int dataShards, int capacity) {
+    if (dataShards <= 0 || capacity <= 0) {
+        throw std::invalid_argument("invalid arguments");
+    }
+
+    matrixCache cache;
+    cache.m_dataShards = dataShards;
+    cache.m_capacity = capacity;
+
+    // Keep the load factor at or below one half so probe sequences stay
+    // short.
+    uint32_t slots = 16;
+    while (slots < uint32_t(capacity) * 2) {
+        slots <<= 1;
+    }
+    cache.m_slotMask = slots - 1;
+    cache.m_table.assign(slots, npos);
+    cache.m_entries.reserve(capacity);
+    return cache;
+}
+
+uint32_t matrixCache::findSlot(const erasureMask &mask) const {
+    if (m_table.empty()) {
+        return npos;
+    }
+    uint32_t slot = uint32_t(mask.hash()) & m_slotMask;
+    for (;;) {
+        uint32_t e = m_table[slot];
+        if (e == npos) {
+            return npos;
+        }
+        if (m_entries[e].key == mask) {
+            return slot;
+        }
+        slot = (slot + 1) & m_slotMask;
+    }
+}
+
+const byte *matrixCache::Find(const erasureMask &mask) const {
+    uint32_t slot = findSlot(mask);
+    if (slot == npos) {
+        return nullptr;
+    }
+    uint32_t e = m_table[slot];
+    return &m_storage[std::size_t(e) * m_dataShards * m_dataShards];
+}
+
+const byte *matrixCache::Get(const erasureMask &mask) {
+    uint32_t slot = findSlot(mask);
+    if (slot == npos) {
+        return nullptr;
+    }
+    uint32_t e = m_table[slot];
+    if (e != m_head) {
+        unlink(e);
+        pushFront(e);
+    }
+    return matrixAt(e);
+}
+
+const byte *matrixCache::Insert(const erasureMask &mask, matrix &m) {
+    if (m_table.empty()) {
+        throw std::runtime_error("matrix cache is not initialized");
+    }
+    if (m.rows != m_dataShards || m.cols != m_dataShards) {
+        throw std::invalid_argument("matrix size does not match");
+    }
+
+    uint32_t e;
+    uint32_t slot = findSlot(mask);
+    if (slot != npos) {
+        e = m_table[slot];
+        unlink(e);
+    } else {
+        if (m_entries.size() < std::size_t(m_capacity)) {
+            e = uint32_t(m_entries.size());
+            m_entries.push_back(entry{});
+            m_storage.resize(m_entries.size() * m_dataShards * m_dataShards);
+        } else {
+            // Reuse the least recently used entry.
+            e = m_tail;
+            unlink(e);
+            eraseSlot(findSlot(m_entries[e].key));
+        }
+        m_entries[e].key = mask;
+
+        slot = uint32_t(mask.hash()) & m_slotMask;
+        while (m_table[slot] != npos) {
+            slot = (slot + 1) & m_slotMask;
+        }
+        m_table[slot] = e;
+    }
+
+    byte *dst = matrixAt(e);
+    for (int r = 0; r < m_dataShards; r++) {
+        memcpy(dst + r * m_dataShards, m.data[r]->data(), m_dataShards);
+    }
+    pushFront(e);
+    return dst;
+}
+
+void matrixCache::eraseSlot(uint32_t slot) {
+    // Backward shift deletion keeps linear probing free of tombstones.
+    uint32_t hole = slot;
+    uint32_t next = slot;
+    for (;;) {
+        next = (next + 1) & m_slotMask;
+        uint32_t e = m_table[next];
+        if (e == npos) {
+            break;
+        }
+        uint32_t home = uint32_t(m_entries[e].key.hash()) & m_slotMask;
+        // Move the entry into the hole unless its home slot lies
+        // cyclically in (hole, next].
+        bool stays = (hole <= next) ? (hole < home && home <= next)
+                                    : (hole < home || home <= next);
+        if (!stays) {
+            m_table[hole] = e;
+            hole = next;
+        }
+    }
+    m_table[hole] = npos;
+}
+
+void matrixCache::unlink(uint32_t e) {
+    entry &en = m_entries[e];
+    if (en.prev != npos) {
+        m_entries[en.prev].next = en.next;
+    } else {
+        m_head = en.next;
+    }
+    if (en.next != npos) {
+        m_entries[en.next].prev = en.prev;
+    } else {
+        m_tail = en.prev;
+    }
+    en.prev = en.next = npos;
+}
+
+void matrixCache::pushFront(uint32_t e) {
+    entry &en = m_entries[e];
+    en.prev = npos;
+    en.next = m_head;
+    if (m_head != npos) {
+        m_entries[m_head].prev = e;
+    }
+    m_head = e;
+    if (m_tail == npos) {
+        m_tail = e;
+    }
+}
+
+std::size_t matrixCache::MemoryUsage() const {
+    return m_table.capacity() * sizeof(uint32_t) +
+           m_entries.capacity() * sizeof(entry) + m_storage.capacity();
+}
@@ -0,0 +1,94 @@
+#ifndef KCP_MATRIX_CACHE_H
+#define KCP_MATRIX_CACHE_H
+
+#include "matrix.h"
+#include <stdint.h>
+#include <vector>
+
+// erasureMask is a bitmask over the shard indices of a set (at most 256
+// shards). A set bit marks an invalid row of the data to reconstruct.
+struct erasureMask {
+    uint64_t bits[4]{0, 0, 0, 0};
+
+    inline void set(int i) { bits[i >> 6] |= uint64_t(1) << (i & 63); }
+
+    inline bool test(int i) const { return (bits[i >> 6] >> (i & 63)) & 1; }
+
+    inline bool empty() const {
+        return (bits[0] | bits[1] | bits[2] | bits[3]) == 0;
+    }
+
+    inline bool operator==(const erasureMask &o) const {
+        return bits[0] == o.bits[0] && bits[1] == o.bits[1] &&
+               bits[2] == o.bits[2] && bits[3] == o.bits[3];
+    }
+
+    inline uint64_t hash() const {
+        uint64_t h = bits[0] * 0x9e3779b97f4a7c15ull;
+        h ^= bits[1] * 0xc2b2ae3d27d4eb4full;
+        h ^= bits[2] * 0x165667b19e3779f9ull;
+        h ^= bits[3] * 0x85ebca77c2b2ae63ull;
+        return h ^ (h >> 29);
+    }
+};
+
+// matrixCache stores inverted decode matrices keyed by the erasure mask of
+// the rows that were missing when they were computed. It is a flat
+// open-addressing table with a bounded number of entries; once full, the
+// least recently used matrix is evicted. Each matrix is kept as dataShards
+// contiguous rows of dataShards bytes.
+class matrixCache {
+public:
+    matrixCache() = default;
+
+    // newMatrixCache creates a cache holding at most 'capacity' inverted
+    // matrices of dataShards x dataShards.
+    static matrixCache newMatrixCache(int dataShards, int capacity);
+
+    // Get returns the cached matrix for mask, or nullptr if it is not
+    // cached, and marks it as most recently used. It never allocates.
+    const byte *Get(const erasureMask &mask);
+
+    // Find is Get without touching the LRU order, so a cache that is no
+    // longer written to can be read from several threads.
+    const byte *Find(const erasureMask &mask) const;
+
+    // Insert copies the square matrix m into the cache keyed by mask and
+    // returns the cached copy. Pointers returned earlier by Get, Find or
+    // Insert are only valid until the next Insert.
+    const byte *Insert(const erasureMask &mask, matrix &m);
+
+    int Size() const { return int(m_entries.size()); }
+
+    // MemoryUsage returns the bytes held by the table, entries and matrices.
+    std::size_t MemoryUsage() const;
+
+private:
+    enum : uint32_t { npos = 0xffffffff };
+
+    struct entry {
+        erasureMask key;
+        uint32_t prev;
+        uint32_t next;
+    };
+
+    uint32_t findSlot(const erasureMask &mask) const;
+    void eraseSlot(uint32_t slot);
+    void unlink(uint32_t e);
+    void pushFront(uint32_t e);
+
+    inline byte *matrixAt(uint32_t e) {
+        return &m_storage[std::size_t(e) * m_dataShards * m_dataShards];
+    }
+
+    int m_dataShards{0};
+    int m_capacity{0};
+    uint32_t m_slotMask{0};
+    std::vector<uint32_t> m_table; // entry index per slot, or npos
+    std::vector<entry> m_entries;
+    std::vector<byte> m_storage;
+    uint32_t m_head{npos}; // most recently used
+    uint32_t m_tail{npos}; // least recently used
+};
+
+#endif // KCP_MATRIX_CACHE_H
@@ -0,0 +1,115 @@
+#include "pacer.h"
+#include "config.h"
+#include <cmath>
+
+// datagrams dropped for a full pacing queue
+static kvar drop_kvar("PaceDrop");
+
+void DeliveryRate::sample(uint64_t now_us, uint32_t delivered, uint32_t srtt_ms,
+                          bool app_limited) {
+    if (!started_) {
+        started_ = true;
+        start_us_ = now_us;
+        start_delivered_ = delivered;
+        return;
+    }
+    auto elapsed = now_us - start_us_;
+    if (elapsed < uint64_t(std::max(srtt_ms, 1u)) * 1000) {
+        return;
+    }
+    double r = double(delivered - start_delivered_) * segment_ * 1000 / double(elapsed);
+    start_us_ = now_us;
+    start_delivered_ = delivered;
+    if (app_limited && r <= rate()) {
+        return;
+    }
+    samples_[next_] = r;
+    next_ = (next_ + 1) % rounds;
+}
+
+double DeliveryRate::rate() const {
+    return *std::max_element(samples_, samples_ + rounds);
+}
+
+Pacer::Pacer(asio::io_service &service, Output output)
+    : service_(service), output_(output), tokens_(capacity()) {}
+
+double Pacer::capacity() const {
+    // the wheel releases at most once a millisecond, so hold two of them
+    return std::max(double(FLAGS_paceburst) * FLAGS_mtu, rate_ * 2);
+}
+
+void Pacer::refill() {
+    auto now = current_monotonic_usec();
+    if (last_us_ != 0) {
+        tokens_ += rate_ * double(now - last_us_) / 1000;
+        tokens_ = std::min(tokens_, capacity());
+    }
+    last_us_ = now;
+}
+
+void Pacer::set_rate(double rate) {
+    refill();
+    rate_ = rate;
+    if (rate_ <= 0) {
+        drain();
+    }
+}
+
+void Pacer::send(const char *buf, std::size_t len) {
+    if (rate_ <= 0 && queue_.empty()) {
+        output_((char *)buf, len);
+        return;
+    }
+    refill();
+    if (queue_.empty() && tokens_ >= double(len)) {
+        tokens_ -= double(len);
+        output_((char *)buf, len);
+        return;
+    }
+    if (queue_.size() >= std::size_t(FLAGS_sndwnd) * 4) {
+        drop_kvar.add(1);
+        return;
+    }
+    std::vector<char> pkt;
+    if (!spare_.empty()) {
+        pkt.swap(spare_.back());
+        spare_.pop_back();
+    }
+    pkt.assign(buf, buf + len);
+    queue_.push_back(std::move(pkt));
+    schedule();
+}
+
+void Pacer::drain() {
+    refill();
+    while (!queue_.empty()) {
+        auto &pkt = queue_.front();
+        if (rate_ > 0) {
+            if (tokens_ < double(pkt.size())) {
+                break;
+            }
+            tokens_ -= double(pkt.size());
+        }
+        output_(pkt.data(), pkt.size());
+        if (spare_.size() < 64) {
+            spare_.push_back(std::move(pkt));
+        }
+        queue_.pop_front();
+    }
+    schedule();
+}
+
+void Pacer::schedule() {
+    if (queue_.empty() || rate_ <= 0) {
+        return;
+    }
+    auto need = double(queue_.front().size()) - tokens_;
+    auto ms = uint32_t(std::max(std::ceil(need / rate_), 1.0));
+    TimingWheel::of(service_).arm_earliest(timer_, ms, [this] { drain(); });
+}
+
+void Pacer::clear() {
+    timer_.cancel();
+    queue_.clear();
+}
@@ -0,0 +1,68 @@
+#ifndef KCPTUN_PACER_H
+#define KCPTUN_PACER_H
+
+#include "timing_wheel.h"
+#include "utils.h"
+
+// DeliveryRate estimates the bandwidth of a session from how fast the
+// peer acknowledges its data, segment by segment: the cumulative ack would
+// credit a whole window at once when a hole is filled. A sample spans about a round trip, and the
+// estimate is the largest of the last few, so a lull does not drag it
+// down. Samples taken while the sender had too little to fill its window
+// only count when they raise it.
+class DeliveryRate {
+public:
+    explicit DeliveryRate(std::size_t segment) : segment_(segment) {}
+
+    // 'delivered' counts the segments acknowledged so far.
+    void sample(uint64_t now_us, uint32_t delivered, uint32_t srtt_ms,
+                bool app_limited);
+    // In bytes per millisecond, 0 until the first sample.
+    double rate() const;
+
+private:
+    static const int rounds = 10;
+
+    std::size_t segment_;
+    double samples_[rounds] = {};
+    int next_ = 0;
+    bool started_ = false;
+    uint64_t start_us_ = 0;
+    uint32_t start_delivered_ = 0;
+};
+
+// Pacer spaces the datagrams of a session out at a given rate instead of
+// handing a whole flush to the socket back to back. Up to --paceburst
+// datagrams pass at once after a quiet spell; the rest wait their turn on
+// the timing wheel, to the millisecond. Datagrams beyond four send
+// windows are dropped, KCP sends them again (kvar PaceDrop).
+class Pacer final {
+public:
+    using Output = std::function<void(char *, std::size_t)>;
+
+    Pacer(asio::io_service &service, Output output);
+
+    // In bytes per millisecond, 0 to pass everything through.
+    void set_rate(double rate);
+    double rate() const { return rate_; }
+    void send(const char *buf, std::size_t len);
+    // Drops what is queued.
+    void clear();
+
+private:
+    double capacity() const;
+    void refill();
+    void drain();
+    void schedule();
+
+    asio::io_service &service_;
+    Output output_;
+    TimerNode timer_;
+    std::deque<std::vector<char>> queue_;
+    std::vector<std::vector<char>> spare_; // buffers of datagrams sent
+    double rate_ = 0;
+    double tokens_;
+    uint64_t last_us_ = 0;
+};
+
+#endif
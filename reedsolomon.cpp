@@ -26,56 +26,252 @@
 
 #include "reedsolomon.h"
 #include "galois_noasm.h"
+#include <algorithm>
+#include <atomic>
 #include <iostream>
+#include <map>
+#include <mutex>
 #include <stdexcept>
+#include <string.h>
+#include <thread>
 #include <vector>
 
+// precomputedMatrices holds the decode matrices pinned by Precompute. The
+// cache is written once before 'ready' is set and only read afterwards.
+struct precomputedMatrices {
+    std::atomic<bool> ready{false};
+    matrixCache cache;
+};
+
+static std::mutex precomputedLock;
+static std::map<std::pair<int, int>, std::shared_ptr<precomputedMatrices>>
+    precomputed;
+
+static const std::size_t maxPrecomputedBytes = 64 << 20;
+
 ReedSolomon::ReedSolomon(int dataShards, int parityShards)
     : m_dataShards(dataShards), m_parityShards(parityShards),
-      m_totalShards(dataShards + parityShards) {
-    tree = inversionTree::newInversionTree(dataShards, parityShards);
+      m_totalShards(dataShards + parityShards) {}
+
+// Upper bound of inverted matrices kept per encoder. Every erasure pattern
+// of a (10,3) set fits; larger sets evict the least recently used ones.
+static const int decodeMatrixCacheSize = 256;
+
+extern "C" byte mulTable[256][256];
+
+// codeShardsFixed is codeSomeShards for exactly D data shards. Each output
+// row is produced in one pass, 8 bytes at a time, with the D table rows of
+// its coefficients kept at hand, instead of D passes over the output.
+template <int D>
+static void codeShardsFixed(const byte *const *matrixRows,
+                            const byte *const *inputs, byte *const *outputs,
+                            int outputCount, std::size_t byteCount) {
+    const byte *mt[D];
+    for (int r = 0; r < outputCount; r++) {
+        for (int c = 0; c < D; c++) {
+            mt[c] = mulTable[matrixRows[r][c]];
+        }
+        byte *out = outputs[r];
+        std::size_t i = 0;
+        for (; i + 8 <= byteCount; i += 8) {
+            uint64_t acc = 0;
+            for (int c = 0; c < D; c++) {
+                const byte *in = inputs[c] + i;
+                const byte *t = mt[c];
+                acc ^= uint64_t(t[in[0]]) | uint64_t(t[in[1]]) << 8 |
+                       uint64_t(t[in[2]]) << 16 | uint64_t(t[in[3]]) << 24 |
+                       uint64_t(t[in[4]]) << 32 | uint64_t(t[in[5]]) << 40 |
+                       uint64_t(t[in[6]]) << 48 | uint64_t(t[in[7]]) << 56;
+            }
+            // Bytes were packed little end first, store them the same way.
+            for (int k = 0; k < 8; k++) {
+                out[i + k] = byte(acc >> (8 * k));
+            }
+        }
+        for (; i < byteCount; i++) {
+            byte acc = 0;
+            for (int c = 0; c < D; c++) {
+                acc ^= mt[c][inputs[c][i]];
+            }
+            out[i] = acc;
+        }
+    }
 }
 
-ReedSolomon ReedSolomon::New(int dataShards, int parityShards) {
+ReedSolomon ReedSolomon::New(int dataShards, int parityShards,
+                             bool xorParity) {
     if (dataShards <= 0 || parityShards <= 0) {
         throw std::invalid_argument(
             "cannot create Encoder with zero or less data/parity shards");
     }
 
+    if (xorParity && parityShards != 1) {
+        throw std::invalid_argument(
+            "cannot create xor parity Encoder with more than one parity shard");
+    }
+
     if (dataShards + parityShards > 255) {
         throw std::invalid_argument(
             "cannot create Encoder with 255 or more data+parity shards");
     }
 
     ReedSolomon r(dataShards, parityShards);
+    r.m_xorParity = xorParity;
+
+    if (xorParity) {
+        // The identity matrix on top of a row of ones.  Any square
+        // subset of its rows is invertible too, and the parity shard
+        // is the plain xor of the data shards.
+        r.m = matrix::newMatrix(r.m_totalShards, r.m_dataShards);
+        for (int c = 0; c < dataShards; c++) {
+            r.m.at(c, c) = 1;
+            r.m.at(dataShards, c) = 1;
+        }
+    } else {
+        // Start with a Vandermonde matrix.  This matrix would work,
+        // in theory, but doesn't have the property that the data
+        // shards are unchanged after encoding.
+        matrix vm = matrix::vandermonde(r.m_totalShards, r.m_dataShards);
+
+        // Multiply by the inverse of the top square of the matrix.
+        // This will make the top square be the identity matrix, but
+        // preserve the property that any square subset of rows  is
+        // invertible.
+        auto top = vm.SubMatrix(0, 0, dataShards, dataShards);
+        top = top.Invert();
+        r.m = vm.Multiply(top);
+    }
+
+    // Inverted matrices are cached keyed by the bitmask of the invalid
+    // rows of the data to reconstruct.
+    r.cache = matrixCache::newMatrixCache(dataShards, decodeMatrixCacheSize);
+
+    // Attach the matrices pinned by Precompute for this shape, if any.
+    // They are derived from the Vandermonde matrix.
+    if (!xorParity) {
+        std::lock_guard<std::mutex> lock(precomputedLock);
+        auto it = precomputed.find(std::make_pair(dataShards, parityShards));
+        if (it != precomputed.end()) {
+            r.pinned = it->second;
+        }
+    }
+
+    // The shapes most tunnels run with get their own kernels.
+    if (!xorParity) {
+        auto shape = std::make_pair(dataShards, parityShards);
+        if (shape == std::make_pair(10, 3)) {
+            r.kernel = codeShardsFixed<10>;
+        } else if (shape == std::make_pair(20, 10)) {
+            r.kernel = codeShardsFixed<20>;
+        } else if (shape == std::make_pair(5, 5)) {
+            r.kernel = codeShardsFixed<5>;
+        } else if (shape == std::make_pair(70, 30)) {
+            r.kernel = codeShardsFixed<70>;
+        }
+    }
 
-    // Start with a Vandermonde matrix.  This matrix would work,
-    // in theory, but doesn't have the property that the data
-    // shards are unchanged after encoding.
-    matrix vm = matrix::vandermonde(r.m_totalShards, r.m_dataShards);
-
-    // Multiply by the inverse of the top square of the matrix.
-    // This will make the top square be the identity matrix, but
-    // preserve the property that any square subset of rows  is
-    // invertible.
-    auto top = vm.SubMatrix(0, 0, dataShards, dataShards);
-    top = top.Invert();
-    r.m = vm.Multiply(top);
-
-    // Inverted matrices are cached in a tree keyed by the indices
-    // of the invalid rows of the data to reconstruct.
-    // The inversion m_root node will have the identity matrix as
-    // its inversion matrix because it implies there are no errors
-    // with the original data.
-    r.tree = inversionTree::newInversionTree(dataShards, parityShards);
-
-    r.parity = std::vector<row_type>(parityShards);
+    r.parity.resize(parityShards * dataShards);
     for (int i = 0; i < parityShards; i++) {
-        r.parity[i] = r.m.data[dataShards + i];
+        std::copy(r.m.data[dataShards + i]->begin(),
+                  r.m.data[dataShards + i]->end(),
+                  r.parity.begin() + i * dataShards);
     }
     return r;
 }
 
+// Reconstruct only looks up the lost rows found before it has collected
+// dataShards valid ones, so a pattern with e lost rows is a choice of e of
+// the first dataShards + e - 1 rows.
+static double countPatterns(int dataShards, int e) {
+    double n = 1;
+    for (int i = 0; i < e; i++) {
+        n = n * (dataShards + e - 1 - i) / (i + 1);
+    }
+    return n;
+}
+
+std::size_t ReedSolomon::Precompute(int dataShards, int parityShards,
+                                    int maxErasures, bool background,
+                                    std::function<void(std::size_t)> done) {
+    auto r = New(dataShards, parityShards);
+    if (maxErasures > parityShards) {
+        maxErasures = parityShards;
+    }
+
+    double patterns = 0;
+    int erasures = 0;
+    while (erasures < maxErasures) {
+        double n = patterns + countPatterns(dataShards, erasures + 1);
+        if (n * dataShards * dataShards > maxPrecomputedBytes) {
+            break;
+        }
+        patterns = n;
+        erasures++;
+    }
+    if (erasures == 0) {
+        return 0;
+    }
+
+    auto table = std::make_shared<precomputedMatrices>();
+    {
+        std::lock_guard<std::mutex> lock(precomputedLock);
+        precomputed[std::make_pair(dataShards, parityShards)] = table;
+    }
+
+    auto build = [r, table, erasures, patterns, done]() mutable {
+        auto cache = matrixCache::newMatrixCache(r.m_dataShards, int(patterns));
+        std::vector<int> lost;
+        std::vector<int> validIndices(r.m_dataShards);
+        for (int e = 1; e <= erasures; e++) {
+            // Walk all combinations of e rows out of the first
+            // dataShards + e - 1 in lexicographic order.
+            int rows = r.m_dataShards + e - 1;
+            lost.resize(e);
+            for (int i = 0; i < e; i++) {
+                lost[i] = i;
+            }
+            for (;;) {
+                erasureMask mask;
+                int v = 0;
+                for (int row = 0, k = 0; row <= rows; row++) {
+                    if (k < e && lost[k] == row) {
+                        mask.set(row);
+                        k++;
+                    } else {
+                        validIndices[v++] = row;
+                    }
+                }
+                auto inverted = r.invertSubMatrix(validIndices);
+                cache.Insert(mask, inverted);
+
+                int i = e - 1;
+                while (i >= 0 && lost[i] == rows - e + i) {
+                    i--;
+                }
+                if (i < 0) {
+                    break;
+                }
+                lost[i]++;
+                for (int j = i + 1; j < e; j++) {
+                    lost[j] = lost[j - 1] + 1;
+                }
+            }
+        }
+        table->cache = std::move(cache);
+        table->ready.store(true, std::memory_order_release);
+        if (done) {
+            done(table->cache.MemoryUsage());
+        }
+    };
+
+    if (background) {
+        std::thread(build).detach();
+    } else {
+        build();
+    }
+    return std::size_t(patterns) * dataShards * dataShards;
+}
+
 void ReedSolomon::Encode(std::vector<row_type> &shards) {
     if (shards.size() != m_totalShards) {
         throw std::invalid_argument("too few shards given");
@@ -83,31 +279,75 @@ void ReedSolomon::Encode(std::vector<row_type> &shards) {
 
     checkShards(shards, false);
 
-    // Get the slice of output buffers.
-    std::vector<row_type> output(shards.begin() + m_dataShards, shards.end());
+    // Get the slice of input and output buffers.
+    std::vector<const byte *> input(m_dataShards);
+    for (int i = 0; i < m_dataShards; i++) {
+        input[i] = shards[i]->data();
+    }
+    std::vector<byte *> output(m_parityShards);
+    std::vector<const byte *> matrixRows(m_parityShards);
+    for (int i = 0; i < m_parityShards; i++) {
+        output[i] = shards[m_dataShards + i]->data();
+        matrixRows[i] = &parity[i * m_dataShards];
+    }
 
     // Do the coding.
-    std::vector<row_type> input(shards.begin(), shards.begin() + m_dataShards);
-    codeSomeShards(parity, input, output, m_parityShards);
+    if (m_xorParity) {
+        xorShards(input.data(), m_dataShards, output[0], shardSize(shards));
+        return;
+    }
+    codeSomeShards(matrixRows.data(), input.data(), output.data(),
+                   m_parityShards, shardSize(shards));
 };
 
-void ReedSolomon::codeSomeShards(std::vector<row_type> &matrixRows,
-                                 std::vector<row_type> &inputs,
-                                 std::vector<row_type> &outputs,
-                                 int outputCount) {
+void ReedSolomon::xorShards(const byte *const *inputs, int inputCount,
+                            byte *output, std::size_t byteCount) {
+    memcpy(output, inputs[0], byteCount);
+    for (int i = 1; i < inputCount; i++) {
+        galXorSlice(inputs[i], output, byteCount);
+    }
+}
+
+void ReedSolomon::codeSomeShards(const byte *const *matrixRows,
+                                 const byte *const *inputs,
+                                 byte *const *outputs, int outputCount,
+                                 std::size_t byteCount) {
+    if (kernel != nullptr) {
+        kernel(matrixRows, inputs, outputs, outputCount, byteCount);
+        return;
+    }
     for (int c = 0; c < m_dataShards; c++) {
         auto in = inputs[c];
         for (int iRow = 0; iRow < outputCount; iRow++) {
             if (c == 0) {
-                galMulSlice((*matrixRows[iRow])[c], in, outputs[iRow]);
+                galMulSliceRaw(matrixRows[iRow][c], in, outputs[iRow],
+                               byteCount);
             } else {
-                galMulSliceXor((*matrixRows[iRow])[c], in, outputs[iRow]);
+                galMulSliceXorRaw(matrixRows[iRow][c], in, outputs[iRow],
+                                  byteCount);
             }
         }
     }
 }
 
 void ReedSolomon::Reconstruct(std::vector<row_type> &shards) {
+    reconstruct(shards, nullptr, false);
+}
+
+void ReedSolomon::ReconstructData(std::vector<row_type> &shards) {
+    reconstruct(shards, nullptr, true);
+}
+
+void ReedSolomon::ReconstructData(std::vector<row_type> &shards,
+                                  std::vector<byte *> &dst) {
+    if (dst.size() < m_dataShards) {
+        throw std::invalid_argument("too few destination buffers given");
+    }
+    reconstruct(shards, &dst, true);
+}
+
+void ReedSolomon::reconstruct(std::vector<row_type> &shards,
+                              std::vector<byte *> *dst, bool dataOnly) {
     if (shards.size() != m_totalShards) {
         throw std::invalid_argument("too few shards given");
     }
@@ -120,13 +360,18 @@ void ReedSolomon::Reconstruct(std::vector<row_type> &shards) {
     // Quick check: are all of the shards present?  If so, there's
     // nothing to do.
     int numberPresent = 0;
+    int dataPresent = 0;
     for (int i = 0; i < m_totalShards; i++) {
         if (shards[i] != nullptr) {
             numberPresent++;
+            if (i < m_dataShards) {
+                dataPresent++;
+            }
         }
     }
 
-    if (numberPresent == m_totalShards) {
+    if (numberPresent == m_totalShards ||
+        (dataOnly && dataPresent == m_dataShards)) {
         // Cool.  All of the shards data data.  We don't
         // need to do anything.
         return;
@@ -137,67 +382,74 @@ void ReedSolomon::Reconstruct(std::vector<row_type> &shards) {
         throw std::invalid_argument("too few shards given");
     }
 
+    // With xor parity exactly one shard is missing here, and it is the
+    // xor of all the others.
+    if (m_xorParity) {
+        std::vector<const byte *> inputs;
+        inputs.reserve(m_dataShards);
+        int lost = 0;
+        for (int i = 0; i < m_totalShards; i++) {
+            if (shards[i] == nullptr) {
+                lost = i;
+            } else {
+                inputs.push_back(shards[i]->data());
+            }
+        }
+        byte *output;
+        if (dst != nullptr) {
+            output = (*dst)[lost];
+        } else {
+            shards[lost] = std::make_shared<std::vector<byte>>(shardSize);
+            output = shards[lost]->data();
+        }
+        xorShards(inputs.data(), m_dataShards, output, shardSize);
+        return;
+    }
+
     // Pull out an array holding just the shards that
     // correspond to the rows of the submatrix.  These shards
     // will be the Input to the decoding process that re-creates
     // the missing data shards.
     //
     // Also, create an array of indices of the valid rows we do have
-    // and the invalid rows we don't have up until we have enough valid rows.
-    std::vector<row_type> subShards(m_dataShards);
+    // and a mask of the invalid rows we don't have up until we have
+    // enough valid rows.
+    std::vector<const byte *> subShards(m_dataShards);
     std::vector<int> validIndices(m_dataShards, 0);
-    std::vector<int> invalidIndices;
+    erasureMask invalidMask;
     int subMatrixRow = 0;
 
     for (int matrixRow = 0;
          matrixRow < m_totalShards && subMatrixRow < m_dataShards;
          matrixRow++) {
         if (shards[matrixRow] != nullptr) {
-            subShards[subMatrixRow] = shards[matrixRow];
+            subShards[subMatrixRow] = shards[matrixRow]->data();
             validIndices[subMatrixRow] = matrixRow;
             subMatrixRow++;
         } else {
-            invalidIndices.push_back(matrixRow);
+            invalidMask.set(matrixRow);
         }
     }
 
-    // Attempt to get the cached inverted matrix out of the tree
-    // based on the indices of the invalid rows.
-    auto dataDecodeMatrix = tree.GetInvertedMatrix(invalidIndices);
-
-    // If the inverted matrix isn't cached in the tree yet we must
-    // construct it ourselves and insert it into the tree for the
-    // future.  In this way the inversion tree is lazily loaded.
-    if (dataDecodeMatrix.empty()) {
-        // Pull out the rows of the matrix that correspond to the
-        // shards that we have and build a square matrix.  This
-        // matrix could be used to generate the shards that we have
-        // from the original data.
-        auto subMatrix = matrix::newMatrix(m_dataShards, m_dataShards);
-        for (subMatrixRow = 0; subMatrixRow < validIndices.size();
-             subMatrixRow++) {
-            for (int c = 0; c < m_dataShards; c++) {
-                subMatrix.at(subMatrixRow, c) =
-                    m.at(validIndices[subMatrixRow], c);
-            };
+    // Attempt to get the inverted matrix based on the mask of the invalid
+    // rows, from the pinned matrices first and the cache second. Without
+    // any invalid data row there is nothing to decode and only parity is
+    // recomputed below.
+    const byte *dataDecodeMatrix = nullptr;
+    if (!invalidMask.empty()) {
+        if (pinned && pinned->ready.load(std::memory_order_acquire)) {
+            dataDecodeMatrix = pinned->cache.Find(invalidMask);
         }
-
-        // Invert the matrix, so we can go from the encoded shards
-        // back to the original data.  Then pull out the row that
-        // generates the shard that we want to Decode.  Note that
-        // since this matrix maps back to the original data, it can
-        // be used to create a data shard, but not a parity shard.
-        dataDecodeMatrix = subMatrix.Invert();
-        if (dataDecodeMatrix.empty()) {
-            throw std::runtime_error("cannot get matrix invert");
+        if (dataDecodeMatrix == nullptr) {
+            dataDecodeMatrix = cache.Get(invalidMask);
         }
 
-        // Cache the inverted matrix in the tree for future use keyed on the
-        // indices of the invalid rows.
-        int ret = tree.InsertInvertedMatrix(invalidIndices, dataDecodeMatrix,
-                                            m_totalShards);
-        if (ret != 0) {
-            throw std::runtime_error("cannot insert matrix invert");
+        // If the inverted matrix isn't cached yet we must construct it
+        // ourselves and insert it into the cache for the future.  In this
+        // way the cache is lazily loaded.
+        if (dataDecodeMatrix == nullptr) {
+            auto inverted = invertSubMatrix(validIndices);
+            dataDecodeMatrix = cache.Insert(invalidMask, inverted);
         }
     }
 
@@ -205,20 +457,30 @@ void ReedSolomon::Reconstruct(std::vector<row_type> &shards) {
     //
     // The Input to the coding is all of the shards we actually
     // have, and the output is the missing data shards.  The computation
-    // is done using the special Decode matrix we just built.
-    std::vector<row_type> outputs(m_parityShards);
-    std::vector<row_type> matrixRows(m_parityShards);
+    // is done using the special Decode matrix we just built. Shards
+    // decoded into caller buffers are left nil in 'shards'.
+    std::vector<byte *> outputs(m_parityShards);
+    std::vector<const byte *> matrixRows(m_parityShards);
     int outputCount = 0;
 
     for (int iShard = 0; iShard < m_dataShards; iShard++) {
         if (shards[iShard] == nullptr) {
-            shards[iShard] = std::make_shared<std::vector<byte>>(shardSize);
-            outputs[outputCount] = shards[iShard];
-            matrixRows[outputCount] = dataDecodeMatrix.data[iShard];
+            if (dst != nullptr) {
+                outputs[outputCount] = (*dst)[iShard];
+            } else {
+                shards[iShard] = std::make_shared<std::vector<byte>>(shardSize);
+                outputs[outputCount] = shards[iShard]->data();
+            }
+            matrixRows[outputCount] = dataDecodeMatrix + iShard * m_dataShards;
             outputCount++;
         }
     }
-    codeSomeShards(matrixRows, subShards, outputs, outputCount);
+    codeSomeShards(matrixRows.data(), subShards.data(), outputs.data(),
+                   outputCount, shardSize);
+
+    if (dataOnly) {
+        return;
+    }
 
     // Now that we have all of the data shards intact, we can
     // compute any of the parity that is missing.
@@ -226,16 +488,45 @@ void ReedSolomon::Reconstruct(std::vector<row_type> &shards) {
     // The Input to the coding is ALL of the data shards, including
     // any that we just calculated.  The output is whichever of the
     // data shards were missing.
+    for (int iShard = 0; iShard < m_dataShards; iShard++) {
+        subShards[iShard] = shards[iShard]->data();
+    }
     outputCount = 0;
     for (int iShard = m_dataShards; iShard < m_totalShards; iShard++) {
         if (shards[iShard] == nullptr) {
             shards[iShard] = std::make_shared<std::vector<byte>>(shardSize);
-            outputs[outputCount] = shards[iShard];
-            matrixRows[outputCount] = parity[iShard - m_dataShards];
+            outputs[outputCount] = shards[iShard]->data();
+            matrixRows[outputCount] = &parity[(iShard - m_dataShards) * m_dataShards];
             outputCount++;
         }
     }
-    codeSomeShards(matrixRows, shards, outputs, outputCount);
+    codeSomeShards(matrixRows.data(), subShards.data(), outputs.data(),
+                   outputCount, shardSize);
+}
+
+matrix ReedSolomon::invertSubMatrix(std::vector<int> &validIndices) {
+    // Pull out the rows of the matrix that correspond to the
+    // shards that we have and build a square matrix.  This
+    // matrix could be used to generate the shards that we have
+    // from the original data.
+    auto subMatrix = matrix::newMatrix(m_dataShards, m_dataShards);
+    for (int subMatrixRow = 0; subMatrixRow < validIndices.size();
+         subMatrixRow++) {
+        for (int c = 0; c < m_dataShards; c++) {
+            subMatrix.at(subMatrixRow, c) = m.at(validIndices[subMatrixRow], c);
+        };
+    }
+
+    // Invert the matrix, so we can go from the encoded shards
+    // back to the original data.  Then pull out the row that
+    // generates the shard that we want to Decode.  Note that
+    // since this matrix maps back to the original data, it can
+    // be used to create a data shard, but not a parity shard.
+    auto inverted = subMatrix.Invert();
+    if (inverted.empty()) {
+        throw std::runtime_error("cannot get matrix invert");
+    }
+    return inverted;
 }
 
 void ReedSolomon::checkShards(std::vector<row_type> &shards, bool nilok) {
@@ -27,11 +27,16 @@
 #ifndef KCP_REEDSOLOMON_H
 #define KCP_REEDSOLOMON_H
 
+#include "erasure_coder.h"
 #include "galois.h"
-#include "inversion_tree.h"
 #include "matrix.h"
+#include "matrix_cache.h"
+#include <functional>
+#include <memory>
 
-class ReedSolomon {
+struct precomputedMatrices;
+
+class ReedSolomon : public ErasureCoder {
 public:
     ReedSolomon() = default;
 
@@ -41,7 +46,23 @@ public:
     // the number of data shards and parity shards that
     // you want to use. You can reuse this encoder.
     // Note that the maximum number of data shards is 256.
-    static ReedSolomon New(int dataShards, int parityShards);
+    // With xorParity the single parity shard is the plain xor of the
+    // data shards (RAID-5 style), which encodes and repairs without any
+    // table lookups. Both ends must agree on it.
+    static ReedSolomon New(int dataShards, int parityShards,
+                           bool xorParity = false);
+
+    // Precompute inverts the decode matrices of every erasure pattern with
+    // up to maxErasures lost shards for the given shape, and pins them for
+    // all encoders created by New afterwards. With 'background' the work is
+    // done in a detached thread and encoders pick the matrices up once it
+    // finishes. maxErasures is lowered if the matrices would not fit in
+    // 64MB. Returns the bytes the matrices alone will take, an estimate;
+    // 'done' gets what they take with the cache's tables once pinned,
+    // called from the detached thread with 'background'.
+    static std::size_t Precompute(int dataShards, int parityShards,
+                                  int maxErasures, bool background,
+                                  std::function<void(std::size_t)> done = nullptr);
 
     // Encodes parity for a set of data shards.
     // An array 'shards' containing data shards followed by parity shards.
@@ -49,7 +70,7 @@ public:
     // Each shard is a byte array, and they must all be the same empty.
     // The parity shards will always be overwritten and the data shards
     // will remain the same.
-    void Encode(std::vector<row_type> &shards);
+    void Encode(std::vector<row_type> &shards) override;
 
     // Reconstruct will recreate the missing shards, if possible.
     //
@@ -64,32 +85,68 @@ public:
     //
     // The reconstructed shard set is complete, but integrity is not verified.
     // Use the Verify function to check if data set is ok.
-    void Reconstruct(std::vector<row_type> &shards);
+    void Reconstruct(std::vector<row_type> &shards) override;
+
+    // ReconstructData is like Reconstruct, but only recreates the missing
+    // data shards. Missing parity shards are left nil, which saves the
+    // cost of encoding them again when only the data is wanted.
+    void ReconstructData(std::vector<row_type> &shards) override;
+
+    // ReconstructData decodes each missing data shard i straight into
+    // dst[i], which must hold at least the shard size, instead of
+    // allocating it. The missing shards stay nil in 'shards'. Entries of
+    // dst for shards that are present are not touched.
+    void ReconstructData(std::vector<row_type> &shards,
+                         std::vector<byte *> &dst) override;
 
 private:
     int m_dataShards;   // Number of data shards, should not be modified.
     int m_parityShards; // Number of parity shards, should not be modified.
     int m_totalShards;  // Total number of shards. Calculated, and should not be
                         // modified.
+    bool m_xorParity{false}; // Single parity shard is the xor of the data.
+
+    // Kernel of codeSomeShards specialised for the number of data shards
+    // of a common shape, or nullptr for the generic loops.
+    using codeKernel = void (*)(const byte *const *matrixRows,
+                                const byte *const *inputs,
+                                byte *const *outputs, int outputCount,
+                                std::size_t byteCount);
+    codeKernel kernel{nullptr};
 
     matrix m;
-    inversionTree tree;
-    std::vector<row_type> parity;
+    matrixCache cache;
+    std::shared_ptr<precomputedMatrices> pinned; // shared, read-only
+    std::vector<byte> parity; // parity rows of m, contiguous
 
     int shardSize(std::vector<row_type> &shards);
 
+    // Inverts the square submatrix of m made of the rows in validIndices.
+    matrix invertSubMatrix(std::vector<int> &validIndices);
+
     // Multiplies a subset of rows from a coding matrix by a full set of
     // Input shards to produce some output shards.
     // 'matrixRows' is The rows from the matrix to use.
     // 'inputs' An array of byte arrays, each of which is one Input shard.
+    // Every array holds byteCount bytes.
     // The number of inputs used is determined by the length of each matrix row.
     // outputs Byte arrays where the computed shards are stored.
     // The number of outputs computed, and the
     // number of matrix rows used, is determined by
     // outputCount, which is the number of outputs to compute.
-    void codeSomeShards(std::vector<row_type> &matrixRows,
-                        std::vector<row_type> &inputs,
-                        std::vector<row_type> &outputs, int outputCount);
+    void codeSomeShards(const byte *const *matrixRows,
+                        const byte *const *inputs, byte *const *outputs,
+                        int outputCount, std::size_t byteCount);
+
+    // Xors inputCount inputs of byteCount bytes into output.
+    void xorShards(const byte *const *inputs, int inputCount, byte *output,
+                   std::size_t byteCount);
+
+    // Shared body of Reconstruct and ReconstructData. Missing data shards
+    // are decoded into dst when it is given, and parity is skipped with
+    // dataOnly.
+    void reconstruct(std::vector<row_type> &shards, std::vector<byte *> *dst,
+                     bool dataOnly);
 
     // checkShards will check if shards are the same size
     // or 0, if allowed. An error is returned if this fails.
@@ -0,0 +1,629 @@
+#include "ring_kcp.h"
+#include "encoding.h"
+#include <algorithm>
+#include <string.h>
+
+namespace {
+
+const uint32_t overhead = 24;
+const uint8_t cmdPush = 81; // cmd: push data
+const uint8_t cmdAck = 82;  // cmd: ack
+const uint8_t cmdWask = 83; // cmd: window probe (ask)
+const uint8_t cmdWins = 84; // cmd: window size (tell)
+const uint32_t askSend = 1; // need to send cmdWask
+const uint32_t askTell = 2; // need to send cmdWins
+const uint32_t wndRcv = 128;
+const int32_t rtoNdl = 30;
+const int32_t rtoMin = 100;
+const int32_t rtoMax = 60000;
+const uint32_t threshMin = 2;
+const uint32_t probeInit = 7000;
+const uint32_t probeLimit = 120000;
+const std::size_t blocksPerChunk = 64;
+
+inline int32_t diff(uint32_t later, uint32_t earlier) {
+    return int32_t(later - earlier);
+}
+
+// orders the resend heap soonest first
+bool later(const std::pair<uint32_t, uint32_t> &a,
+           const std::pair<uint32_t, uint32_t> &b) {
+    return diff(a.first, b.first) > 0;
+}
+
+byte *encode_seg(byte *p, uint32_t conv, uint8_t cmd, uint8_t frg, uint16_t wnd,
+                 uint32_t ts, uint32_t sn, uint32_t una, uint32_t len) {
+    p = encode32u(p, conv);
+    *p++ = cmd;
+    *p++ = frg;
+    p = encode16u(p, wnd);
+    p = encode32u(p, ts);
+    p = encode32u(p, sn);
+    p = encode32u(p, una);
+    return encode32u(p, len);
+}
+
+} // namespace
+
+void RingKCP::ring::grow(uint32_t span, uint32_t base) {
+    if (!slots_.empty() && span <= mask_ + 1) {
+        return;
+    }
+    uint32_t cap = 64;
+    while (cap < span) {
+        cap <<= 1;
+    }
+    ring bigger;
+    bigger.slots_.resize(cap);
+    bigger.bits_.resize(cap / 64);
+    bigger.mask_ = cap - 1;
+    // every segment held lies within the old capacity from base
+    if (!slots_.empty()) {
+        each(base, base + mask_ + 1, [&](uint32_t sn) {
+            bigger.put(sn, std::move(at(sn)));
+        });
+    }
+    std::swap(*this, bigger);
+}
+
+RingKCP::RingKCP(uint32_t conv, Output output)
+    : output_(output), conv_(conv), snd_buf_(32), rcv_buf_(wndRcv) {
+    buffer_.resize((mtu_ + overhead) * 3);
+}
+
+void RingKCP::nodelay(int nodelay, int interval, int resend, int nc) {
+    if (nodelay >= 0) {
+        nodelay_ = uint32_t(nodelay);
+        rx_minrto_ = nodelay ? rtoNdl : rtoMin;
+    }
+    if (interval >= 0) {
+        interval_ = uint32_t(std::min(std::max(interval, 10), 5000));
+    }
+    if (resend >= 0) {
+        fastresend_ = resend;
+    }
+    if (nc >= 0) {
+        nocwnd_ = nc != 0;
+    }
+}
+
+void RingKCP::wndsize(int sndwnd, int rcvwnd) {
+    if (sndwnd > 0) {
+        snd_wnd_ = uint32_t(sndwnd);
+        snd_buf_.grow(snd_wnd_, snd_una_);
+    }
+    if (rcvwnd > 0) {
+        rcv_wnd_ = std::max(uint32_t(rcvwnd), wndRcv);
+        rcv_buf_.grow(rcv_wnd_, rcv_nxt_);
+    }
+}
+
+void RingKCP::setmtu(int mtu) {
+    if (mtu < 50 || uint32_t(mtu) < overhead) {
+        return;
+    }
+    mtu_ = uint32_t(mtu);
+    mss_ = mtu_ - overhead;
+    buffer_.resize((mtu_ + overhead) * 3);
+}
+
+void RingKCP::new_data(segment &seg, const char *data, std::size_t len) {
+    if (block_ < mss_) {
+        // blocks too small for the new mtu are left to their chunks
+        block_ = mss_;
+        blocks_.clear();
+    }
+    if (blocks_.empty()) {
+        chunks_.emplace_back(new char[std::size_t(block_) * blocksPerChunk]);
+        auto chunk = chunks_.back().get();
+        for (auto i = blocksPerChunk; i > 0; i--) {
+            blocks_.push_back(chunk + (i - 1) * block_);
+        }
+    }
+    seg.data = blocks_.back();
+    blocks_.pop_back();
+    seg.cap = block_;
+    seg.len = uint32_t(len);
+    if (len > 0) {
+        memcpy(seg.data, data, len);
+    }
+}
+
+void RingKCP::release(segment &seg) {
+    if (seg.cap == block_) {
+        blocks_.push_back(seg.data);
+    }
+    seg.data = nullptr;
+    seg.len = 0;
+}
+
+int RingKCP::send(const char *buffer, std::size_t len) {
+    if (stream_) {
+        // append to the last segment queued if it has room
+        if (!snd_queue_.empty()) {
+            auto &last = snd_queue_.back();
+            auto room = std::min(mss_, last.cap);
+            if (last.len < room) {
+                auto extend = std::min(len, std::size_t(room - last.len));
+                memcpy(last.data + last.len, buffer, extend);
+                last.len += uint32_t(extend);
+                buffer += extend;
+                len -= extend;
+            }
+        }
+        if (len == 0) {
+            return 0;
+        }
+    }
+
+    std::size_t count = len <= mss_ ? 1 : (len + mss_ - 1) / mss_;
+    if (count >= wndRcv) {
+        return -2;
+    }
+    for (std::size_t i = 0; i < count; i++) {
+        auto size = std::min(len, std::size_t(mss_));
+        segment seg;
+        new_data(seg, buffer, size);
+        seg.frg = stream_ ? 0 : uint8_t(count - i - 1);
+        snd_queue_.push_back(std::move(seg));
+        buffer += size;
+        len -= size;
+    }
+    return 0;
+}
+
+int RingKCP::peeksize() const {
+    if (rcv_queue_.empty()) {
+        return -1;
+    }
+    auto &first = rcv_queue_.front();
+    if (first.frg == 0) {
+        return int(first.len);
+    }
+    if (rcv_queue_.size() < std::size_t(first.frg) + 1) {
+        return -1;
+    }
+    int length = 0;
+    for (auto &seg : rcv_queue_) {
+        length += int(seg.len);
+        if (seg.frg == 0) {
+            break;
+        }
+    }
+    return length;
+}
+
+bool RingKCP::front(const char **data, std::size_t *len) const {
+    if (peeksize() <= 0) {
+        return false;
+    }
+    *data = rcv_queue_.front().data;
+    *len = rcv_queue_.front().len;
+    return true;
+}
+
+void RingKCP::pop_front() {
+    if (rcv_queue_.empty()) {
+        return;
+    }
+    bool recover = rcv_queue_.size() >= rcv_wnd_;
+    release(rcv_queue_.front());
+    rcv_queue_.pop_front();
+    move_rcv_buf();
+    // tell the sender the window opened again
+    if (rcv_queue_.size() < rcv_wnd_ && recover) {
+        probe_ |= askTell;
+    }
+}
+
+void RingKCP::update_ack(int32_t rtt) {
+    if (rx_srtt_ == 0) {
+        rx_srtt_ = rtt;
+        rx_rttval_ = rtt / 2;
+    } else {
+        int32_t delta = rtt - rx_srtt_;
+        if (delta < 0) {
+            delta = -delta;
+        }
+        rx_rttval_ = (3 * rx_rttval_ + delta) / 4;
+        rx_srtt_ = (7 * rx_srtt_ + rtt) / 8;
+        if (rx_srtt_ < 1) {
+            rx_srtt_ = 1;
+        }
+    }
+    int32_t rto = rx_srtt_ + std::max(int32_t(interval_), 4 * rx_rttval_);
+    rx_rto_ = std::min(std::max(rx_minrto_, rto), rtoMax);
+}
+
+void RingKCP::parse_una(uint32_t una) {
+    if (diff(una, snd_una_) <= 0) {
+        return;
+    }
+    if (diff(una, snd_nxt_) > 0) {
+        una = snd_nxt_;
+    }
+    snd_buf_.each(snd_una_, una, [this](uint32_t sn) {
+        release(snd_buf_.at(sn));
+        snd_buf_.clear(sn);
+        nsnd_buf_--;
+        delivered_++;
+    });
+}
+
+void RingKCP::parse_ack(uint32_t sn) {
+    if (diff(sn, snd_una_) < 0 || diff(sn, snd_nxt_) >= 0) {
+        return;
+    }
+    if (snd_buf_.has(sn)) {
+        release(snd_buf_.at(sn));
+        snd_buf_.clear(sn);
+        nsnd_buf_--;
+        delivered_++;
+    }
+}
+
+void RingKCP::shrink_buf() {
+    while (snd_una_ != snd_nxt_ && !snd_buf_.has(snd_una_)) {
+        snd_una_++;
+    }
+}
+
+void RingKCP::parse_data(uint32_t sn, uint8_t frg, const char *data,
+                         uint32_t len) {
+    if (diff(sn, rcv_nxt_ + rcv_wnd_) >= 0 || diff(sn, rcv_nxt_) < 0) {
+        return;
+    }
+    if (!rcv_buf_.has(sn)) {
+        segment seg;
+        seg.sn = sn;
+        seg.frg = frg;
+        new_data(seg, data, len);
+        rcv_buf_.put(sn, std::move(seg));
+    }
+    move_rcv_buf();
+}
+
+void RingKCP::move_rcv_buf() {
+    while (rcv_queue_.size() < rcv_wnd_ && rcv_buf_.has(rcv_nxt_)) {
+        rcv_queue_.push_back(std::move(rcv_buf_.at(rcv_nxt_)));
+        rcv_buf_.clear(rcv_nxt_);
+        rcv_nxt_++;
+    }
+}
+
+uint16_t RingKCP::wnd_unused() const {
+    if (rcv_queue_.size() < rcv_wnd_) {
+        return uint16_t(rcv_wnd_ - rcv_queue_.size());
+    }
+    return 0;
+}
+
+int RingKCP::input(const char *data, std::size_t size) {
+    auto prev_una = snd_una_;
+    uint32_t maxack = 0;
+    bool flag = false;
+
+    if (data == nullptr || size < overhead) {
+        return -1;
+    }
+
+    auto p = (byte *)data;
+    while (size >= overhead) {
+        uint32_t conv, ts, sn, una, len;
+        uint16_t wnd;
+        p = decode32u(p, &conv);
+        if (conv != conv_) {
+            return -1;
+        }
+        uint8_t cmd = *p++;
+        uint8_t frg = *p++;
+        p = decode16u(p, &wnd);
+        p = decode32u(p, &ts);
+        p = decode32u(p, &sn);
+        p = decode32u(p, &una);
+        p = decode32u(p, &len);
+        size -= overhead;
+        if (size < len) {
+            return -2;
+        }
+        if (cmd != cmdPush && cmd != cmdAck && cmd != cmdWask &&
+            cmd != cmdWins) {
+            return -3;
+        }
+
+        rmt_wnd_ = wnd;
+        parse_una(una);
+        shrink_buf();
+
+        if (cmd == cmdAck) {
+            if (diff(current_, ts) >= 0) {
+                update_ack(diff(current_, ts));
+            }
+            parse_ack(sn);
+            shrink_buf();
+            if (!flag) {
+                flag = true;
+                maxack = sn;
+            } else if (diff(sn, maxack) > 0) {
+                maxack = sn;
+            }
+        } else if (cmd == cmdPush) {
+            if (diff(sn, rcv_nxt_ + rcv_wnd_) < 0) {
+                acklist_.emplace_back(sn, ts);
+                if (diff(sn, rcv_nxt_) >= 0) {
+                    parse_data(sn, frg, (const char *)p, len);
+                }
+            }
+        } else if (cmd == cmdWask) {
+            probe_ |= askTell;
+        }
+
+        p += len;
+        size -= len;
+    }
+
+    // counted against the segments sent before it at the next flush
+    if (flag && diff(maxack, snd_una_) >= 0 && diff(maxack, snd_nxt_) < 0) {
+        fastacks_.push_back(maxack);
+    }
+
+    if (diff(snd_una_, prev_una) > 0 && cwnd_ < rmt_wnd_) {
+        auto mss = mss_;
+        if (cwnd_ < ssthresh_) {
+            cwnd_++;
+            incr_ += mss;
+        } else {
+            if (incr_ < mss) {
+                incr_ = mss;
+            }
+            incr_ += (mss * mss) / incr_ + (mss / 16);
+            if ((cwnd_ + 1) * mss <= incr_) {
+                cwnd_ = (incr_ + mss - 1) / (mss > 0 ? mss : 1);
+            }
+        }
+        if (cwnd_ > rmt_wnd_) {
+            cwnd_ = rmt_wnd_;
+            incr_ = rmt_wnd_ * mss;
+        }
+    }
+    return 0;
+}
+
+bool RingKCP::stale(const std::pair<uint32_t, uint32_t> &due) {
+    auto sn = due.second;
+    return diff(sn, snd_una_) < 0 || diff(sn, snd_nxt_) >= 0 ||
+           !snd_buf_.has(sn) || snd_buf_.at(sn).resendts != due.first;
+}
+
+void RingKCP::resend_due(uint32_t sn, uint32_t resendts) {
+    // Entries of acked or rescheduled segments are left in the heap. Once
+    // they outnumber the live ones, one per segment held, they are swept
+    // out, so the heap stays the size of the window.
+    if (resends_.size() >= 2 * std::size_t(nsnd_buf_) + 64) {
+        resends_.erase(std::remove_if(resends_.begin(), resends_.end(),
+                                      [this](const std::pair<uint32_t, uint32_t> &due) {
+                                          return stale(due);
+                                      }),
+                       resends_.end());
+        std::make_heap(resends_.begin(), resends_.end(), later);
+    }
+    resends_.emplace_back(resendts, sn);
+    std::push_heap(resends_.begin(), resends_.end(), later);
+}
+
+void RingKCP::update(uint32_t current) {
+    current_ = current;
+    if (!updated_) {
+        updated_ = true;
+        ts_flush_ = current_;
+    }
+
+    auto slap = diff(current_, ts_flush_);
+    if (slap >= 10000 || slap < -10000) {
+        ts_flush_ = current_;
+        slap = 0;
+    }
+    if (slap >= 0) {
+        ts_flush_ += interval_;
+        if (diff(current_, ts_flush_) >= 0) {
+            ts_flush_ = current_ + interval_;
+        }
+        flush();
+    }
+}
+
+uint32_t RingKCP::check(uint32_t current) const {
+    if (!updated_) {
+        return current;
+    }
+    auto ts_flush = ts_flush_;
+    if (diff(current, ts_flush) >= 10000 || diff(current, ts_flush) < -10000) {
+        ts_flush = current;
+    }
+    if (diff(current, ts_flush) >= 0) {
+        return current;
+    }
+    // Retransmissions only go out from update's flush at ts_flush, so the
+    // scan of the send window ikcp makes here cannot wake it for anything.
+    return current + std::min(uint32_t(diff(ts_flush, current)), interval_);
+}
+
+void RingKCP::flush() {
+    if (!updated_) {
+        return;
+    }
+    auto current = current_;
+    auto wnd = wnd_unused();
+    auto base = (byte *)buffer_.data();
+    auto ptr = base;
+    auto make_room = [&](std::size_t need) {
+        if (std::size_t(ptr - base) + need > mtu_) {
+            output_(buffer_.data(), std::size_t(ptr - base));
+            ptr = base;
+        }
+    };
+
+    // flush acknowledges
+    for (auto &ack : acklist_) {
+        make_room(overhead);
+        ptr = encode_seg(ptr, conv_, cmdAck, 0, wnd, ack.second, ack.first,
+                         rcv_nxt_, 0);
+    }
+    acklist_.clear();
+
+    // probe window size if the remote window is closed
+    if (rmt_wnd_ == 0) {
+        if (probe_wait_ == 0) {
+            probe_wait_ = probeInit;
+            ts_probe_ = current + probe_wait_;
+        } else if (diff(current, ts_probe_) >= 0) {
+            if (probe_wait_ < probeInit) {
+                probe_wait_ = probeInit;
+            }
+            probe_wait_ += probe_wait_ / 2;
+            if (probe_wait_ > probeLimit) {
+                probe_wait_ = probeLimit;
+            }
+            ts_probe_ = current + probe_wait_;
+            probe_ |= askSend;
+        }
+    } else {
+        ts_probe_ = 0;
+        probe_wait_ = 0;
+    }
+    if (probe_ & askSend) {
+        make_room(overhead);
+        ptr = encode_seg(ptr, conv_, cmdWask, 0, wnd, 0, 0, rcv_nxt_, 0);
+    }
+    if (probe_ & askTell) {
+        make_room(overhead);
+        ptr = encode_seg(ptr, conv_, cmdWins, 0, wnd, 0, 0, rcv_nxt_, 0);
+    }
+    probe_ = 0;
+
+    // move data from snd_queue to snd_buf
+    auto cwnd = std::min(snd_wnd_, rmt_wnd_);
+    if (!nocwnd_) {
+        cwnd = std::min(cwnd_, cwnd);
+    }
+    auto first_new = snd_nxt_;
+    while (diff(snd_nxt_, snd_una_ + cwnd) < 0 && !snd_queue_.empty()) {
+        snd_buf_.grow(snd_nxt_ - snd_una_ + 1, snd_una_);
+        auto &seg = snd_queue_.front();
+        seg.sn = snd_nxt_;
+        seg.fastack = 0;
+        seg.xmit = 0;
+        snd_buf_.put(snd_nxt_, std::move(seg));
+        snd_queue_.pop_front();
+        snd_nxt_++;
+        nsnd_buf_++;
+    }
+
+    uint32_t resent = fastresend_ > 0 ? uint32_t(fastresend_) : 0xffffffff;
+    uint32_t rtomin = nodelay_ == 0 ? uint32_t(rx_rto_ >> 3) : 0;
+    bool change = false;
+    bool lost = false;
+    auto push = [&](segment &seg) {
+        seg.ts = current;
+        auto len = seg.len;
+        make_room(overhead + len);
+        ptr = encode_seg(ptr, conv_, cmdPush, seg.frg, wnd, seg.ts, seg.sn,
+                         rcv_nxt_, len);
+        if (len > 0) {
+            memcpy(ptr, seg.data, len);
+            ptr += len;
+        }
+        if (seg.xmit >= dead_link_) {
+            state_ = -1;
+        }
+        resend_due(seg.sn, seg.resendts);
+    };
+
+    // retransmit on timeout, dropping the stale entries that come due
+    while (!resends_.empty() && diff(current, resends_.front().first) >= 0) {
+        auto due = resends_.front();
+        std::pop_heap(resends_.begin(), resends_.end(), later);
+        resends_.pop_back();
+        if (stale(due)) {
+            continue;
+        }
+        auto &seg = snd_buf_.at(due.second);
+        seg.xmit++;
+        xmit_++;
+        if (nodelay_ == 0) {
+            seg.rto += std::max(seg.rto, uint32_t(rx_rto_));
+        } else {
+            int32_t step = nodelay_ < 2 ? int32_t(seg.rto) : rx_rto_;
+            seg.rto += step / 2;
+        }
+        seg.resendts = current + seg.rto;
+        lost = true;
+        push(seg);
+    }
+
+    // Each ack recorded by input passes every segment below it once.
+    // Ascending offsets from snd_una let one sweep over the segments held
+    // below the newest of them add them up.
+    std::size_t nfast = 0;
+    for (auto sn : fastacks_) {
+        if (diff(sn, snd_una_) > 0) {
+            fastacks_[nfast++] = sn - snd_una_;
+        }
+    }
+    fastacks_.resize(nfast);
+    std::sort(fastacks_.begin(), fastacks_.end());
+    if (nfast > 0) {
+        std::size_t passed = 0; // offsets at or below the current segment
+        auto una = snd_una_;
+        snd_buf_.each(una, una + fastacks_.back(), [&](uint32_t sn) {
+            auto &seg = snd_buf_.at(sn);
+            while (passed < nfast && fastacks_[passed] <= sn - una) {
+                passed++;
+            }
+            seg.fastack += uint32_t(nfast - passed);
+            // not again if it just timed out
+            if (seg.fastack < resent || seg.ts == current) {
+                return;
+            }
+            if (int(seg.xmit) <= fastlimit_ || fastlimit_ <= 0) {
+                seg.xmit++;
+                seg.fastack = 0;
+                seg.resendts = current + seg.rto;
+                change = true;
+                push(seg);
+            }
+        });
+    }
+    fastacks_.clear();
+
+    // first transmission of the segments just moved
+    for (auto sn = first_new; sn != snd_nxt_; sn++) {
+        auto &seg = snd_buf_.at(sn);
+        seg.xmit++;
+        seg.rto = uint32_t(rx_rto_);
+        seg.resendts = current + seg.rto + rtomin;
+        push(seg);
+    }
+
+    // flush remaining segments
+    if (ptr > base) {
+        output_(buffer_.data(), std::size_t(ptr - base));
+    }
+
+    // update ssthresh
+    if (change) {
+        auto inflight = snd_nxt_ - snd_una_;
+        ssthresh_ = std::max(inflight / 2, threshMin);
+        cwnd_ = ssthresh_ + resent;
+        incr_ = cwnd_ * mss_;
+    }
+    if (lost) {
+        ssthresh_ = std::max(cwnd / 2, threshMin);
+        cwnd_ = 1;
+        incr_ = mss_;
+    }
+    if (cwnd_ < 1) {
+        cwnd_ = 1;
+        incr_ = mss_;
+    }
+}
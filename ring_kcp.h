@@ -0,0 +1,170 @@
+#ifndef KCPTUN_RING_KCP_H
+#define KCPTUN_RING_KCP_H
+
+#include "kcp_core.h"
+#include <deque>
+#include <memory>
+#include <utility>
+#include <vector>
+
+// RingKCP runs the KCP protocol of ikcp, with its retransmission and
+// congestion rules, but keeps the send and receive windows in rings
+// indexed by sequence number rather than on linked lists. Marking an ACK,
+// placing a received segment and delivering past a filled hole cost the
+// same whatever the window, so --sndwnd and --rcvwnd in the thousands
+// stay cheap on long fat links. Fast retransmit counts, which ikcp bumps
+// across the whole send window on every packet, are tallied once a flush
+// over the segments still unacked below the newest ACK, and retransmit
+// timeouts come off a heap rather than a scan of the window.
+class RingKCP : public KCPCore {
+public:
+    RingKCP(uint32_t conv, Output output);
+
+    void set_stream(bool stream) override { stream_ = stream; }
+    void nodelay(int nodelay, int interval, int resend, int nc) override;
+    void wndsize(int sndwnd, int rcvwnd) override;
+    void setmtu(int mtu) override;
+
+    int input(const char *data, std::size_t size) override;
+    int send(const char *buffer, std::size_t len) override;
+    int peeksize() const override;
+    bool front(const char **data, std::size_t *len) const override;
+    void pop_front() override;
+    int waitsnd() const override {
+        return int(nsnd_buf_ + snd_queue_.size());
+    }
+    uint32_t rcv_nxt() const override { return rcv_nxt_; }
+    uint32_t snd_una() const override { return snd_una_; }
+    uint32_t srtt() const override { return uint32_t(rx_srtt_); }
+    uint32_t delivered() const override { return delivered_; }
+
+    void update(uint32_t current) override;
+    uint32_t check(uint32_t current) const override;
+    void flush() override;
+
+private:
+    struct segment {
+        uint32_t sn = 0;
+        uint32_t ts = 0;
+        uint32_t resendts = 0;
+        uint32_t rto = 0;
+        uint32_t fastack = 0;
+        uint32_t xmit = 0;
+        uint8_t frg = 0;
+        // a block of the core's, see new_data
+        char *data = nullptr;
+        uint32_t len = 0;
+        uint32_t cap = 0;
+    };
+
+    // Slot sn & mask holds segment sn; a bitmap tells them from the holes.
+    class ring {
+    public:
+        explicit ring(uint32_t span) { grow(span, 0); }
+        // grow makes room for 'span' sequence numbers from 'base' on.
+        void grow(uint32_t span, uint32_t base);
+        bool has(uint32_t sn) const {
+            return (bits_[(sn & mask_) >> 6] >> (sn & 63)) & 1;
+        }
+        segment &at(uint32_t sn) { return slots_[sn & mask_]; }
+        void put(uint32_t sn, segment &&seg) {
+            slots_[sn & mask_] = std::move(seg);
+            bits_[(sn & mask_) >> 6] |= uint64_t(1) << (sn & 63);
+        }
+        void clear(uint32_t sn) {
+            bits_[(sn & mask_) >> 6] &= ~(uint64_t(1) << (sn & 63));
+        }
+        // each calls f with every sequence number held in [begin, end),
+        // skipping the holes a bitmap word at a time.
+        template <typename F> void each(uint32_t begin, uint32_t end, F f);
+
+    private:
+        ring() = default;
+        std::vector<segment> slots_;
+        std::vector<uint64_t> bits_;
+        uint32_t mask_ = 0;
+    };
+
+    void resend_due(uint32_t sn, uint32_t resendts);
+    bool stale(const std::pair<uint32_t, uint32_t> &due);
+    void update_ack(int32_t rtt);
+    void parse_una(uint32_t una);
+    void parse_ack(uint32_t sn);
+    void shrink_buf();
+    void parse_data(uint32_t sn, uint8_t frg, const char *data, uint32_t len);
+    void move_rcv_buf();
+    uint16_t wnd_unused() const;
+    // Payloads live in blocks of an mss, carved from chunks the core keeps
+    // and recycled most recently freed first, so a window of any size
+    // costs no malloc and reuses memory still in cache.
+    void new_data(segment &seg, const char *data, std::size_t len);
+    void release(segment &seg);
+
+    Output output_;
+    uint32_t conv_;
+    uint32_t mtu_ = 1400;
+    uint32_t mss_ = 1400 - 24;
+    int state_ = 0;
+    uint32_t snd_una_ = 0;
+    uint32_t snd_nxt_ = 0;
+    uint32_t rcv_nxt_ = 0;
+    uint32_t ssthresh_ = 2;
+    int32_t rx_rttval_ = 0;
+    int32_t rx_srtt_ = 0;
+    int32_t rx_rto_ = 200;
+    int32_t rx_minrto_ = 100;
+    uint32_t snd_wnd_ = 32;
+    uint32_t rcv_wnd_ = 128;
+    uint32_t rmt_wnd_ = 128;
+    uint32_t cwnd_ = 0;
+    uint32_t incr_ = 0;
+    uint32_t probe_ = 0;
+    uint32_t current_ = 0;
+    uint32_t interval_ = 100;
+    uint32_t ts_flush_ = 100;
+    uint32_t xmit_ = 0;
+    uint32_t nodelay_ = 0;
+    bool updated_ = false;
+    uint32_t ts_probe_ = 0;
+    uint32_t probe_wait_ = 0;
+    uint32_t dead_link_ = 20;
+    int fastresend_ = 0;
+    int fastlimit_ = 5;
+    bool nocwnd_ = false;
+    bool stream_ = false;
+
+    std::deque<segment> snd_queue_;
+    std::deque<segment> rcv_queue_;
+    ring snd_buf_;
+    ring rcv_buf_;
+    uint32_t nsnd_buf_ = 0;
+    uint32_t delivered_ = 0;
+    std::vector<std::pair<uint32_t, uint32_t>> acklist_; // sn, ts
+    std::vector<uint32_t> fastacks_; // newest ack of each input since flush
+    std::vector<std::pair<uint32_t, uint32_t>> resends_; // heap of resendts, sn
+    std::vector<char> buffer_;
+    std::vector<std::unique_ptr<char[]>> chunks_;
+    std::vector<char *> blocks_; // free ones
+    uint32_t block_ = 0;         // their size
+};
+
+template <typename F>
+void RingKCP::ring::each(uint32_t begin, uint32_t end, F f) {
+    for (auto sn = begin; sn != end;) {
+        // a ring is whole words long, so a word never wraps
+        auto idx = sn & mask_;
+        uint64_t word = bits_[idx >> 6] >> (idx & 63);
+        uint32_t room = 64 - (idx & 63);
+        if (end - sn < room) {
+            room = end - sn;
+            word &= (uint64_t(1) << room) - 1;
+        }
+        while (word != 0) {
+            f(sn + uint32_t(__builtin_ctzll(word)));
+            word &= word - 1;
+        }
+        sn += room;
+    }
+}
+
+#endif
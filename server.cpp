@@ -17,8 +17,9 @@ void Server::run(AcceptHandler accept_handler, uint32_t convid) {
     in = [this](char *buf, std::size_t len, Handler handler) {
         sess_->async_input(buf, len, handler);
     };
+    std::shared_ptr<AsyncInOutputer> fec_in;
     if (fec) {
-        auto fec_in = std::make_shared<AsyncFECInputer>(in);
+        fec_in = make_fec_inputer(service_, in);
         in = [this, fec_in](char *buf, std::size_t len, Handler handler) {
             fec_in->async_input(buf, len, handler);
         };
@@ -28,13 +29,17 @@ void Server::run(AcceptHandler accept_handler, uint32_t convid) {
         output(buf, len, handler);
     };
     if (fec) {
-        auto fec_out = std::make_shared<AsyncFECOutputer>(out);
+        auto fec_out = make_fec_outputer(service_, out);
+        link_fec_stages(fec_in, fec_out, out);
         out = [this, fec_out](char *buf, std::size_t len, Handler handler) {
             fec_out->async_input(buf, len, handler);
         };
     }
     sess_ = std::make_shared<Session>(service_, convid, out);
     sess_->run();
+    if (fec) {
+        sess_->set_recovery_hint(fec_recovery_hint(fec_in));
+    }
 
     out2 = [this](char *buf, std::size_t len, Handler handler) {
         sess_->async_write(buf, len, handler);
@@ -48,6 +53,18 @@ void Server::run(AcceptHandler accept_handler, uint32_t convid) {
         };
     }
     smux_ = std::make_shared<smux>(service_, out2);
+    smux_->set_flush_handler([this] {
+        if (sess_) {
+            sess_->flush_soon();
+        }
+    });
+    if (FLAGS_nocomp) {
+        // compression joins frames into its own buffer anyway
+        smux_->set_writev_handler([this](const Slice *slices, std::size_t n,
+                                         Handler handler) {
+            sess_->async_writev(slices, n, handler);
+        });
+    }
     smux_->set_accept_handler(accept_handler);
     smux_->call_on_destroy([this, self]{
         destroy();
@@ -75,18 +92,21 @@ void Server::async_input(char *buf, std::size_t len, Handler handler) {
 
 void Server::do_sess_receive() {
     auto self = shared_from_this();
-    sess_->async_read_some(
-        sbuf_, sizeof(sbuf_), [this, self](std::error_code ec, std::size_t sz) {
+    auto sess = sess_;
+    sess->async_read_view([this, self, sess](std::error_code ec,
+                                             const char *data, std::size_t sz) {
+        if (ec) {
+            return;
+        }
+        in2((char *)data, sz, [this, self, sess, sz](std::error_code ec,
+                                                     std::size_t) {
             if (ec) {
                 return;
             }
-            in2(sbuf_, sz, [this, self](std::error_code ec, std::size_t) {
-                if (ec) {
-                    return;
-                }
-                do_sess_receive();
-            });
+            sess->consume_view(sz);
+            do_sess_receive();
         });
+    });
 }
 
 Server::~Server() {
@@ -18,13 +18,16 @@ public:
     ~Server() override;
     void run(AcceptHandler handler, uint32_t convid);
     void async_input(char *buf, std::size_t len, Handler handler) override;
+    // See Session::set_pacing_handler, valid after run.
+    void set_pacing_handler(std::function<void(double)> handler) {
+        sess_->set_pacing_handler(handler);
+    }
 
 private:
     void do_sess_receive();
     void call_this_on_destroy() override;
 
 private:
-    char sbuf_[2048];
     asio::io_service &service_;
     std::shared_ptr<Session> sess_;
     std::shared_ptr<smux> smux_;
@@ -1,8 +1,25 @@
 #include "sess.h"
 #include "encrypt.h"
+#include "event_loop.h"
+#include "encoding.h"
 #include "fec.h"
 
 static kvar sess_kvar("Session");
+// data segments received that were already delivered
+static kvar dup_kvar("DupSegment");
+
+bool kcp_ack_only(const char *buf, std::size_t len) {
+    std::size_t off = 0;
+    while (off + kcpOverhead <= len) {
+        if (byte(buf[off + 4]) == kcpCmdPush) {
+            return false;
+        }
+        uint32_t sz;
+        decode32u((byte *)(buf + off + 20), &sz);
+        off += kcpOverhead + sz;
+    }
+    return off == len;
+}
 
 Session::Session(asio::io_service &service, uint32_t convid, OutputHandler o)
     : AsyncInOutputer(o), service_(service), convid_(convid), kvar_(sess_kvar) {
@@ -10,31 +27,33 @@ Session::Session(asio::io_service &service, uint32_t convid, OutputHandler o)
 
 Session::~Session() {
     TRACE
-    if (kcp_ != nullptr) {
-        ikcp_release(kcp_);
-    }
 }
 
 void Session::run() {
-    kcp_ = ikcp_create(convid_, static_cast<void *>(this));
-    kcp_->output = Session::output_wrapper;
-    kcp_->stream = 1;
-    ikcp_nodelay(kcp_, FLAGS_nodelay, FLAGS_interval, FLAGS_resend, FLAGS_nc);
-    ikcp_wndsize(kcp_, FLAGS_sndwnd, FLAGS_rcvwnd);
-    ikcp_setmtu(kcp_, FLAGS_mtu);
-    timer_ = std::make_shared<asio::high_resolution_timer>(service_);
-    run_timer(std::chrono::high_resolution_clock::now() + std::chrono::milliseconds(FLAGS_interval));
+    kcp_ = KCPCore::New(FLAGS_kcpcore, convid_,
+                        [this](const char *buffer, std::size_t len) {
+                            output_wrapper(buffer, len);
+                        });
+    if (!cc_) {
+        cc_ = Congestion::New(FLAGS_cc, std::size_t(FLAGS_mtu));
+    }
+    kcp_->set_stream(true);
+    kcp_->nodelay(FLAGS_nodelay, FLAGS_interval, FLAGS_resend,
+                  cc_->kcp_window() ? 0 : 1);
+    kcp_->wndsize(FLAGS_sndwnd, FLAGS_rcvwnd);
+    kcp_->setmtu(FLAGS_mtu);
+    if (FLAGS_pace || FLAGS_kernelpace || cc_->needs_pacing()) {
+        pacer_ = my_make_unique<Pacer>(service_, [this](char *buf, std::size_t len) {
+            output(buf, len, nullptr);
+        });
+    }
+    run_timer(uint32_t(FLAGS_interval));
     // run_peeksize_checker();
 }
 
-void Session::run_timer(std::chrono::high_resolution_clock::time_point pt) {
-    if(timer_->expires_at() <= pt && timer_->expires_from_now() >= std::chrono::milliseconds(0)) {
-        return;
-    } else {
-        timer_->expires_at(pt);
-    }
+void Session::run_timer(uint32_t ms) {
     std::weak_ptr<Session> ws = shared_from_this();
-    timer_->async_wait([this, ws](const std::error_code &) {
+    TimingWheel::of(service_).arm_earliest(timer_, ms, [this, ws] {
         auto s = ws.lock();
         if (!s) {
             return;
@@ -48,7 +67,7 @@ void Session::run_peeksize_checker() {
     auto timer = std::make_shared<asio::high_resolution_timer>(
         service_, std::chrono::seconds(1));
     timer->async_wait([this, self, timer](const std::error_code &) {
-        std::cout << ikcp_peeksize(kcp_) << std::endl;
+        std::cout << kcp_->peeksize() << std::endl;
         run_peeksize_checker();
     });
 }
@@ -60,57 +79,119 @@ void Session::async_input(char *buffer, std::size_t len, Handler handler) {
     }
 }
 
+// count_input counts the data segments already delivered before KCP
+// takes them in.
+void Session::count_input(const char *buffer, std::size_t len) {
+    std::size_t off = 0;
+    while (off + kcpOverhead <= len) {
+        uint32_t sn, sz;
+        decode32u((byte *)(buffer + off + 12), &sn);
+        decode32u((byte *)(buffer + off + 20), &sz);
+        if (byte(buffer[off + 4]) == kcpCmdPush &&
+            int32_t(sn - kcp_->rcv_nxt()) < 0) {
+            dup_kvar.add(1);
+        }
+        off += kcpOverhead + sz;
+    }
+}
+
+void Session::count_retransmits(const char *buffer, std::size_t len) {
+    std::size_t off = 0;
+    while (off + kcpOverhead <= len) {
+        uint32_t sn, sz;
+        decode32u((byte *)(buffer + off + 12), &sn);
+        decode32u((byte *)(buffer + off + 20), &sz);
+        if (byte(buffer[off + 4]) == kcpCmdPush) {
+            if (int32_t(sn - snd_nxt_) < 0) {
+                cc_->on_loss(current_monotonic_usec(), sn);
+            } else {
+                snd_nxt_ = sn + 1;
+            }
+        }
+        off += kcpOverhead + sz;
+    }
+}
+
 void Session::input(char *buffer, std::size_t len) {
-    auto n = ikcp_input(kcp_, buffer, int(len));
+    count_input(buffer, len);
+    auto n = kcp_->input(buffer, len);
     TRACE
-    if (rtask_.check()) {
-        update();
-    } 
+    // a recovered segment may be what the held acks wait for
+    if (rtask_.check() || vtask_ || !held_acks_.empty()) {
+        mark_dirty();
+    }
     return;
 }
 
 void Session::async_read_some(char *buffer, std::size_t len, Handler handler) {
-    if (streambufsiz_ > 0) {
-        auto n = streambufsiz_;
-        if (n > len) {
-            n = len;
-        }
-        memcpy(buffer, stream_buf_, n);
-        streambufsiz_ -= n;
-        if (streambufsiz_ != 0) {
-            memmove(stream_buf_, stream_buf_ + n, streambufsiz_);
-        }
-        if (handler) {
-            handler(std::error_code(0, std::generic_category()),
-                    static_cast<std::size_t>(n));
-        }
-        return;
-    }
-    auto psz = ikcp_peeksize(kcp_);
-    if (psz <= 0) {
+    auto n = read_into(buffer, len);
+    if (n == 0) {
         rtask_.buf = buffer;
         rtask_.len = len;
         rtask_.handler = handler;
         return;
     }
-    auto n = ikcp_recv(kcp_, buffer, int(len));
-    // LOG(INFO) << "ikcp_recv return " << n;
     if (handler) {
-        handler(std::error_code(0, std::generic_category()),
-                static_cast<std::size_t>(n));
+        handler(std::error_code(0, std::generic_category()), n);
     }
-    if (psz > len) {
-        n = ikcp_recv(kcp_, stream_buf_, sizeof(stream_buf_));
-        // LOG(INFO) << "ikcp_recv2 return " << n;
-        streambufsiz_ = n;
+}
+
+void Session::async_read_view(ViewHandler handler) {
+    const char *data;
+    std::size_t len;
+    if (!peek_view(&data, &len)) {
+        vtask_ = handler;
+        return;
     }
-    return;
+    if (handler) {
+        handler(std::error_code(0, std::generic_category()), data, len);
+    }
+}
+
+bool Session::peek_view(const char **data, std::size_t *len) {
+    // stream mode, so every segment is whole on its own
+    const char *seg;
+    std::size_t sz;
+    if (!kcp_->front(&seg, &sz)) {
+        return false;
+    }
+    *data = seg + view_off_;
+    *len = sz - view_off_;
+    return true;
+}
+
+void Session::consume_view(std::size_t n) {
+    const char *seg;
+    std::size_t sz;
+    while (n > 0 && kcp_->front(&seg, &sz)) {
+        auto left = sz - view_off_;
+        if (n < left) {
+            view_off_ += n;
+            return;
+        }
+        n -= left;
+        view_off_ = 0;
+        kcp_->pop_front();
+    }
+}
+
+std::size_t Session::read_into(char *buffer, std::size_t len) {
+    std::size_t n = 0;
+    const char *data;
+    std::size_t sz;
+    while (n < len && peek_view(&data, &sz)) {
+        sz = std::min(sz, len - n);
+        memcpy(buffer + n, data, sz);
+        consume_view(sz);
+        n += sz;
+    }
+    return n;
 }
 
 void Session::async_write(char *buffer, std::size_t len, Handler handler) {
-    auto waitsnd = ikcp_waitsnd(kcp_);
+    auto waitsnd = kcp_->waitsnd();
     if (waitsnd <= FLAGS_sndwnd * 2) {
-        auto n = ikcp_send(kcp_, buffer, int(len)); 
+        auto n = kcp_->send(buffer, len);
         if (handler) {
             handler(std::error_code(0, std::generic_category()),
                     static_cast<std::size_t>(n));
@@ -120,50 +201,141 @@ void Session::async_write(char *buffer, std::size_t len, Handler handler) {
         wtasks_.push_back(Task{buffer, len, handler});
     }
 
-    update();
+    mark_dirty();
+}
+
+void Session::async_writev(const Slice *slices, std::size_t n,
+                           Handler handler) {
+    std::size_t total = 0;
+    for (std::size_t i = 0; i < n; i++) {
+        total += slices[i].len;
+    }
+    auto waitsnd = kcp_->waitsnd();
+    if (waitsnd <= FLAGS_sndwnd * 2 && wtasks_.empty()) {
+        for (std::size_t i = 0; i < n; i++) {
+            kcp_->send(slices[i].buf, slices[i].len);
+        }
+        if (handler) {
+            handler(std::error_code(0, std::generic_category()), total);
+        }
+    } else {
+        // the last slice carries the handler, the others go out before it
+        for (std::size_t i = 0; i < n; i++) {
+            wtasks_.push_back(Task{(char *)slices[i].buf, slices[i].len,
+                                   i + 1 == n ? handler : nullptr});
+        }
+    }
+
+    mark_dirty();
 }
 
-int Session::output_wrapper(const char *buffer, int len, struct IKCPCB *kcp,
-                            void *user)
-{
-    assert(user != nullptr);
-    Session *sess = static_cast<Session *>(user);
-    sess->output((char *)(buffer), static_cast<std::size_t>(len), nullptr);
-    sess->updateWrite();
-    return 0;
+void Session::output_wrapper(const char *buffer, std::size_t len) {
+    count_retransmits(buffer, len);
+    auto ack_only = kcp_ack_only(buffer, len);
+    if (ack_only) {
+        if (hold_acks()) {
+            held_acks_.emplace_back(buffer, buffer + len);
+            return;
+        }
+        release_acks();
+    }
+    // acks are small and late ones would inflate the peer's rtt
+    if (pacer_ && !ack_only) {
+        pacer_->send(buffer, len);
+    } else {
+        output((char *)(buffer), len, nullptr);
+    }
+    updateWrite();
 }
 
-void Session::updateRead() {
-    ikcp_update(kcp_, iclock());
-    if (!rtask_.check()) {
-        return;
+void Session::update_congestion() {
+    // A window not filled says too little about the path to measure it
+    // by, the controller's window where it sets one. Acks have just let
+    // some of it out, so data still waiting for room counts as full.
+    auto window = cwnd_ != 0 ? cwnd_ : uint32_t(FLAGS_sndwnd);
+    auto inflight = snd_nxt_ - kcp_->snd_una();
+    bool app_limited = inflight < window &&
+                       uint32_t(kcp_->waitsnd()) <= inflight;
+    cc_->on_ack(current_monotonic_usec(), kcp_->snd_una(), snd_nxt_,
+                kcp_->delivered(), kcp_->srtt(), app_limited);
+    auto cwnd = std::min(cc_->cwnd(), uint32_t(FLAGS_sndwnd));
+    if (cwnd != 0 && cwnd != cwnd_) {
+        cwnd_ = cwnd;
+        kcp_->wndsize(int(cwnd), 0);
     }
-    auto psz = ikcp_peeksize(kcp_);
-    if (psz <= 0) {
-        return;
+    if (pacer_ || pacing_handler_) {
+        update_pacing();
+    }
+}
+
+void Session::update_pacing() {
+    auto rate = cc_->pacing_rate();
+    if (FLAGS_pacemax > 0) {
+        auto max = double(FLAGS_pacemax) * 125; // Mbit/s in bytes per ms
+        rate = rate == 0 ? max : std::min(rate, max);
+    }
+    if (pacing_handler_) {
+        pacing_handler_(rate);
+    } else {
+        pacer_->set_rate(rate);
+    }
+}
+
+void Session::set_pacing_handler(std::function<void(double)> handler) {
+    pacing_handler_ = handler;
+    if (pacer_) {
+        pacer_->set_rate(0); // let out what it holds
+        pacer_.reset();
+    }
+}
+
+bool Session::hold_acks() {
+    if (!recovery_hint_ || !recovery_hint_()) {
+        holding_ = false;
+        return false;
+    }
+    auto now = iclock();
+    if (!holding_) {
+        holding_ = true;
+        hold_start_ = now;
+    }
+    return now - hold_start_ < uint32_t(FLAGS_fecholdack);
+}
+
+void Session::release_acks() {
+    while (!held_acks_.empty()) {
+        auto &acks = held_acks_.front();
+        output(acks.data(), acks.size(), nullptr);
+        held_acks_.pop_front();
     }
-    auto len = rtask_.len;
-    auto n = ikcp_recv(kcp_, rtask_.buf, int(len));
-    // LOG(INFO) << "ikcp_recv return " << n;
-    auto rtask_handler = rtask_.handler;
-    rtask_.reset();
-    if (rtask_handler) {
-        rtask_handler(std::error_code(0, std::generic_category()),
-                      static_cast<std::size_t>(n));
+}
+
+void Session::updateRead() {
+    kcp_->update(iclock());
+    if (rtask_.check()) {
+        auto n = read_into(rtask_.buf, rtask_.len);
+        if (n > 0) {
+            auto rtask_handler = rtask_.handler;
+            rtask_.reset();
+            if (rtask_handler) {
+                rtask_handler(std::error_code(0, std::generic_category()), n);
+            }
+        }
     }
-    // LOG(INFO) << "psz = " << psz << " pick again is " << ikcp_peeksize(kcp_);
-    if (psz > len) {
-        n = ikcp_recv(kcp_, stream_buf_, sizeof(stream_buf_));
-        // LOG(INFO) << "ikcp_recv2 return " << n;
-        streambufsiz_ = n;
+    const char *data;
+    std::size_t len;
+    if (vtask_ && peek_view(&data, &len)) {
+        auto vtask_handler = vtask_;
+        vtask_ = nullptr;
+        vtask_handler(std::error_code(0, std::generic_category()), data, len);
     }
 }
 
 void Session::updateWrite() {
-    while (ikcp_waitsnd(kcp_) < FLAGS_sndwnd * 2 && !wtasks_.empty()) {
+    while (kcp_->waitsnd() < FLAGS_sndwnd * 2 && !wtasks_.empty()) {
         auto task = wtasks_.front();
         wtasks_.pop_front();
-        auto n = ikcp_send(kcp_, task.buf, int(task.len));
+        auto n = kcp_->send(task.buf, task.len);
         auto &handler = task.handler; 
         if (handler) {
             handler(std::error_code(0, std::generic_category()),
@@ -174,15 +346,51 @@ void Session::updateWrite() {
 
 void Session::updateTimer() {
     auto current = iclock();
-    auto next = ikcp_check(kcp_, current);
+    auto next = kcp_->check(current);
     next -= current;
+    auto hold = uint32_t(FLAGS_fecholdack);
+    if (!held_acks_.empty() && current - hold_start_ < hold) {
+        // wake up when the hold runs out, unless recovery comes first
+        next = std::min(next, hold_start_ + hold - current);
+    }
     // LOG(INFO) << "next = " << next;
-    run_timer(std::chrono::high_resolution_clock::now()+std::chrono::milliseconds(next));
+    run_timer(next);
+}
+
+void Session::mark_dirty() {
+    if (dirty_) {
+        return;
+    }
+    dirty_ = true;
+    std::weak_ptr<Session> ws = shared_from_this();
+    EventLoop::of(service_).defer([this, ws] {
+        auto s = ws.lock();
+        if (!s) {
+            return;
+        }
+        dirty_ = false;
+        if (!is_destroyed()) {
+            update();
+        }
+    });
+}
+
+void Session::flush_soon() {
+    flush_ = true;
+    mark_dirty();
 }
 
 void Session::update() {
+    update_congestion();
     updateRead();
     updateWrite();
+    if (!held_acks_.empty() && !hold_acks()) {
+        release_acks();
+    }
+    if (flush_) {
+        flush_ = false;
+        kcp_->flush();
+    }
     updateTimer();
 }
 
@@ -191,10 +399,12 @@ void Session::call_this_on_destroy() {
 
     Destroy::call_this_on_destroy();
 
-    if (timer_) {
-        timer_->cancel();
-        timer_ = nullptr;
+    timer_.cancel();
+
+    if (pacer_) {
+        pacer_->clear();
     }
+    held_acks_.clear();
 
     if (rtask_.check()) {
         auto rtask_handler = rtask_.handler;
@@ -202,6 +412,12 @@ void Session::call_this_on_destroy() {
         rtask_handler(std::error_code(1, std::generic_category()), 0);
     }
 
+    if (vtask_) {
+        auto vtask_handler = vtask_;
+        vtask_ = nullptr;
+        vtask_handler(std::error_code(1, std::generic_category()), nullptr, 0);
+    }
+
     if (wtask_.check()) {
         auto wtask_handler = wtask_.handler;
         wtask_.reset();
@@ -2,13 +2,25 @@
 #define KCPTUN_SESS_H
 
 #include "config.h"
+#include "congestion.h"
 #include "encrypt.h"
-#include "ikcp.h"
+#include "kcp_core.h"
 #include "matrix.h"
+#include "pacer.h"
+#include "timing_wheel.h"
 #include "utils.h"
 
 class FEC;
 
+// KCP segment layout: conv(4) cmd(1) frg(1) wnd(2) ts(4) sn(4) una(4)
+// len(4) data, any number of them to a datagram.
+const std::size_t kcpOverhead = 24;
+const byte kcpCmdPush = 81;
+
+// Reports whether a datagram from KCP carries no data segment, only acks
+// and window probes.
+bool kcp_ack_only(const char *buf, std::size_t len);
+
 class Session : public std::enable_shared_from_this<Session>,
                 public AsyncReadWriter,
                 public AsyncInOutputer,
@@ -18,36 +30,81 @@ public:
     Session(asio::io_service &service, uint32_t convid, OutputHandler o);
     void run();
     ~Session();
+    // While 'hint' returns true, datagrams of nothing but acks are held
+    // for up to --fecholdack ms, so segments the FEC layer is about to
+    // recover are not reported as gaps to the sender. Data and its
+    // retransmissions go out as usual.
+    void set_recovery_hint(std::function<bool()> hint) { recovery_hint_ = hint; }
+    // Flushes KCP at the end of the event loop iteration rather than at
+    // the next interval tick.
+    void flush_soon();
+    // Hands the pacing rate, in bytes per ms, to 'handler' rather than the
+    // userspace pacer, for a socket the kernel paces.
+    void set_pacing_handler(std::function<void(double)> handler);
+    // Replaces the controller --cc names, before run.
+    void set_congestion(std::unique_ptr<Congestion> cc) { cc_ = std::move(cc); }
 
 private:
-    void run_timer(std::chrono::high_resolution_clock::time_point pt);
-    static int output_wrapper(const char *buffer, int len, struct IKCPCB *kcp,
-                              void *user);
+    void run_timer(uint32_t ms);
+    void output_wrapper(const char *buffer, std::size_t len);
     void update();
+    // Updates once at the end of the event loop iteration.
+    void mark_dirty();
     void updateRead();
     void updateWrite();
     void updateTimer();
     void run_peeksize_checker();
+    bool hold_acks();
+    void release_acks();
+    void count_input(const char *buffer, std::size_t len);
+    void count_retransmits(const char *buffer, std::size_t len);
+    void update_congestion();
+    void update_pacing();
+    bool peek_view(const char **data, std::size_t *len);
+    std::size_t read_into(char *buffer, std::size_t len);
 
 public:
     void input(char *buffer, std::size_t len);
     void async_input(char *buffer, std::size_t len, Handler handler) override;
     void async_read_some(char *buffer, std::size_t len, Handler handler) override;
+
+    using ViewHandler =
+        std::function<void(std::error_code, const char *, std::size_t)>;
+    // Hands 'handler' received data where it lies inside KCP, without
+    // copying it. The view stays valid until consume_view is called, and
+    // no other read may be made before.
+    void async_read_view(ViewHandler handler);
+    // Releases the first n bytes of the data viewed.
+    void consume_view(std::size_t n);
     void async_write(char *buffer, std::size_t len, Handler handler) override;
+    // Stream mode KCP appends each send to the segment before, so the
+    // slices are cut into segments exactly like one contiguous buffer.
+    void async_writev(const Slice *slices, std::size_t n, Handler handler);
     void call_this_on_destroy() override;
 
 private:
     asio::io_service &service_;
-    std::shared_ptr<asio::high_resolution_timer> timer_;
+    TimerNode timer_;
     Task rtask_;
     Task wtask_;
     std::deque<Task> wtasks_;
 
 private:
     uint32_t convid_ = 0;
-    ikcpcb *kcp_ = nullptr;
-    char stream_buf_[65535];
-    std::size_t streambufsiz_ = 0;
+    std::unique_ptr<KCPCore> kcp_;
+    std::unique_ptr<Pacer> pacer_;
+    std::function<void(double)> pacing_handler_;
+    std::unique_ptr<Congestion> cc_;
+    uint32_t snd_nxt_ = 0; // past the highest sequence number sent
+    uint32_t cwnd_ = 0;    // last handed to KCP as its send window
+    std::size_t view_off_ = 0; // consumed from the first segment
+    ViewHandler vtask_;
+    std::function<bool()> recovery_hint_;
+    bool dirty_ = false;
+    bool flush_ = false;
+    bool holding_ = false;
+    uint32_t hold_start_ = 0;
+    std::deque<std::vector<char>> held_acks_;
 };
 
 #endif
@@ -0,0 +1,113 @@
+#include "slab.h"
+#include "config.h"
+#include "ikcp.h"
+
+// Keeps the blocks handed out 16-byte aligned.
+static const size_t blockHeader = 16;
+static const size_t slabSize = 64 * 1024;
+static const int maxClasses = 8;
+static const uint32_t oversized = 0xffffffff;
+
+static size_t classSize[maxClasses];
+static int numClasses = 0;
+
+struct freeBlock {
+    freeBlock *next;
+};
+
+struct slabCache {
+    freeBlock *free[maxClasses];
+    uint32_t hits;
+};
+
+static thread_local slabCache cache;
+
+static kvar hit_kvar("SlabHitK");
+static kvar miss_kvar("SlabMiss");
+static kvar inuse_kvar("SlabInUse");
+
+static void init_classes(size_t largest) {
+    numClasses = 0;
+    for (size_t size = 64; size < largest && numClasses < maxClasses - 1;
+         size *= 2) {
+        classSize[numClasses++] = size;
+    }
+    classSize[numClasses++] = (largest + 15) / 16 * 16;
+}
+
+static char *refill(int c) {
+    miss_kvar.add(1);
+    auto size = classSize[c];
+    auto slab = static_cast<char *>(malloc(slabSize));
+    if (!slab) {
+        return nullptr;
+    }
+    // hand out the first block, keep the rest
+    for (size_t off = slabSize / size * size - size; off >= size; off -= size) {
+        auto b = reinterpret_cast<freeBlock *>(slab + off);
+        b->next = cache.free[c];
+        cache.free[c] = b;
+    }
+    return slab;
+}
+
+void *slab_malloc(size_t size) {
+    auto total = size + blockHeader;
+    int c = 0;
+    while (c < numClasses && classSize[c] < total) {
+        c++;
+    }
+
+    char *block;
+    if (c == numClasses) {
+        miss_kvar.add(1);
+        block = static_cast<char *>(malloc(total));
+        if (!block) {
+            return nullptr;
+        }
+        *reinterpret_cast<uint32_t *>(block) = oversized;
+        return block + blockHeader;
+    }
+
+    if (cache.free[c]) {
+        block = reinterpret_cast<char *>(cache.free[c]);
+        cache.free[c] = cache.free[c]->next;
+        if (++cache.hits == 1000) {
+            cache.hits = 0;
+            hit_kvar.add(1);
+        }
+    } else {
+        block = refill(c);
+        if (!block) {
+            return nullptr;
+        }
+    }
+    inuse_kvar.add(1);
+    *reinterpret_cast<uint32_t *>(block) = uint32_t(c);
+    return block + blockHeader;
+}
+
+void slab_free(void *p) {
+    if (!p) {
+        return;
+    }
+    auto block = static_cast<char *>(p) - blockHeader;
+    auto c = *reinterpret_cast<uint32_t *>(block);
+    if (c == oversized) {
+        free(block);
+        return;
+    }
+    inuse_kvar.sub(1);
+    auto b = reinterpret_cast<freeBlock *>(block);
+    b->next = cache.free[c];
+    cache.free[c] = b;
+}
+
+void install_kcp_allocator() {
+    if (!FLAGS_kcpslab) {
+        return;
+    }
+    // the largest segment KCP cuts for this mtu
+    init_classes(blockHeader + sizeof(IKCPSEG) + size_t(FLAGS_mtu));
+    ikcp_allocator(slab_malloc, slab_free);
+}
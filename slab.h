@@ -0,0 +1,20 @@
+#ifndef KCPTUN_SLAB_H
+#define KCPTUN_SLAB_H
+
+#include <stddef.h>
+
+// A size-classed allocator for KCP segments. Blocks are carved from 64 KB
+// slabs and kept on per-thread free lists when released, so the steady
+// state takes no trip through malloc. Memory stays with the free lists
+// at its peak. Requests beyond the largest class, a segment of --mtu, go
+// to malloc. Counters: SlabHitK (thousands of allocations served from a
+// free list), SlabMiss (slab refills and oversized requests), SlabInUse.
+void *slab_malloc(size_t size);
+void slab_free(void *p);
+
+// Installs the allocator into KCP when --kcpslab is set. Must run before
+// the first ikcp_create. The ring core of --kcpcore recycles its own
+// segment buffers and takes no part.
+void install_kcp_allocator();
+
+#endif
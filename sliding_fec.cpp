@@ -0,0 +1,261 @@
+#include "sliding_fec.h"
+#include "encoding.h"
+#include "galois_noasm.h"
+#include <algorithm>
+#include <stdexcept>
+#include <string.h>
+
+void repairCoefficients(uint32_t repairId, int count, byte *coef) {
+    // xorshift32 seeded by the repair id, mapped onto 1..255.
+    uint32_t x = (repairId * 2654435761u) ^ 0x5bd1e995u;
+    if (x == 0) {
+        x = 1;
+    }
+    for (int i = 0; i < count; i++) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        coef[i] = byte(1 + x % 255);
+    }
+}
+
+slidingEncoder slidingEncoder::New(int window, int sources, int repairs) {
+    if (window <= 0 || sources <= 0 || repairs <= 0 || window > 0xffff) {
+        throw std::invalid_argument("invalid arguments");
+    }
+
+    slidingEncoder enc;
+    enc.window = window;
+    enc.sources = sources;
+    enc.repairs = repairs;
+    enc.history.resize(window);
+    enc.coef.resize(window);
+    return enc;
+}
+
+void slidingEncoder::MarkData(byte *data, uint16_t sz) {
+    if (sinceRepair == sources) {
+        // The repair packets due were not asked for; skip them.
+        sinceRepair = 0;
+        repairsSent = 0;
+    }
+
+    data = encode32u(data, next);
+    data = encode16u(data, typeData);
+    encode16u(data, static_cast<uint16_t>(sz - fecHeaderSize));
+    history[next % window].assign(data, data + sz - fecHeaderSize);
+    next++;
+    sinceRepair++;
+}
+
+size_t slidingEncoder::EncodeRepair(byte *buf) {
+    // Until the window first fills up it covers what was sent so far.
+    int count = next < uint32_t(window) ? int(next) : window;
+    uint32_t first = next - count;
+
+    size_t len = 0;
+    for (int i = 0; i < count; i++) {
+        len = std::max(len, history[(first + i) % window].size());
+    }
+
+    byte *p = encode32u(buf, nextRepair);
+    p = encode16u(p, typeRepair);
+    p = encode32u(p, first);
+    p = encode16u(p, uint16_t(count));
+    memset(p, 0, len);
+    repairCoefficients(nextRepair, count, coef.data());
+    for (int i = 0; i < count; i++) {
+        auto &s = history[(first + i) % window];
+        galMulSliceXorRaw(coef[i], s.data(), p, s.size());
+    }
+
+    nextRepair++;
+    if (++repairsSent == repairs) {
+        sinceRepair = 0;
+        repairsSent = 0;
+    }
+    return repairHeaderSize + len;
+}
+
+slidingDecoder slidingDecoder::New(int window) {
+    if (window <= 0 || window > 0xffff) {
+        throw std::invalid_argument("invalid arguments");
+    }
+
+    // Keep four windows of source symbols, so a repair packet arriving
+    // somewhat late can still be reduced by the sources it covers.
+    std::size_t size = 64;
+    while (size < std::size_t(window) * 4) {
+        size <<= 1;
+    }
+
+    slidingDecoder dec;
+    dec.window = window;
+    dec.sources.resize(size);
+    dec.mask = size - 1;
+    return dec;
+}
+
+uint64_t slidingDecoder::extend(uint32_t seq) {
+    if (!started) {
+        // Leave room below the first sequence number seen.
+        started = true;
+        highest = (uint64_t(1) << 32) + seq;
+        return highest;
+    }
+    return uint64_t(int64_t(highest) + int32_t(seq - uint32_t(highest)));
+}
+
+std::vector<row_type> slidingDecoder::Input(fecPacket &pkt) {
+    std::vector<row_type> recovered;
+    std::vector<equation> work;
+
+    uint64_t first;
+    uint64_t last;
+    if (pkt.flag == typeData) {
+        first = last = extend(pkt.seqid);
+    } else if (pkt.flag == typeRepair && pkt.data->size() >= 6) {
+        uint32_t seq;
+        uint16_t count;
+        byte *p = decode32u(pkt.data->data(), &seq);
+        decode16u(p, &count);
+        if (count == 0 || count > window) {
+            return recovered;
+        }
+        first = extend(seq);
+        last = first + count - 1;
+    } else {
+        return recovered;
+    }
+
+    if (last > highest) {
+        highest = last;
+        // Equations on sources that fell out of the ring are of no use.
+        auto end = pivots.lower_bound(low());
+        pivots.erase(pivots.begin(), end);
+    }
+    if (first < low()) {
+        return recovered;
+    }
+
+    if (pkt.flag == typeData) {
+        if (known(first) == nullptr) {
+            addKnown(first, pkt.data, work);
+        }
+    } else {
+        equation eq;
+        eq.first = first;
+        eq.coef.resize(last - first + 1);
+        repairCoefficients(pkt.seqid, int(eq.coef.size()), eq.coef.data());
+        eq.data.assign(pkt.data->begin() + 6, pkt.data->end());
+        work.push_back(std::move(eq));
+    }
+    solve(work, recovered);
+    return recovered;
+}
+
+void slidingDecoder::addKnown(uint64_t seq, row_type data,
+                              std::vector<equation> &work) {
+    auto &s = sources[seq & mask];
+    s.tag = seq + 1;
+    s.data = data;
+
+    // Equations involving seq are taken out and reduced again.
+    for (auto it = pivots.begin(); it != pivots.end() && it->first <= seq;) {
+        auto &eq = it->second;
+        if (seq < eq.first + eq.coef.size() && eq.coef[seq - eq.first] != 0) {
+            work.push_back(std::move(eq));
+            it = pivots.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+// Drops zero coefficients at both ends.
+static void trim(uint64_t &first, std::vector<byte> &coef) {
+    std::size_t lead = 0;
+    while (lead < coef.size() && coef[lead] == 0) {
+        lead++;
+    }
+    coef.erase(coef.begin(), coef.begin() + lead);
+    first += lead;
+    while (!coef.empty() && coef.back() == 0) {
+        coef.pop_back();
+    }
+}
+
+void slidingDecoder::reduce(equation &eq) {
+    for (std::size_t i = 0; i < eq.coef.size(); i++) {
+        if (eq.coef[i] == 0) {
+            continue;
+        }
+        auto s = known(eq.first + i);
+        if (s == nullptr) {
+            continue;
+        }
+        auto &data = **s;
+        if (eq.data.size() < data.size()) {
+            eq.data.resize(data.size(), 0);
+        }
+        galMulSliceXorRaw(eq.coef[i], data.data(), eq.data.data(),
+                          data.size());
+        eq.coef[i] = 0;
+    }
+    trim(eq.first, eq.coef);
+}
+
+void slidingDecoder::solve(std::vector<equation> &work,
+                           std::vector<row_type> &recovered) {
+    while (!work.empty()) {
+        equation eq = std::move(work.back());
+        work.pop_back();
+        reduce(eq);
+
+        // Forward elimination against the stored pivots. They only hold
+        // unknown sources, so eq does too afterwards.
+        for (;;) {
+            if (eq.coef.empty() || eq.first < low()) {
+                break;
+            }
+            auto it = pivots.find(eq.first);
+            if (it == pivots.end()) {
+                break;
+            }
+            auto &piv = it->second;
+            byte c = eq.coef[0];
+            if (eq.coef.size() < piv.coef.size()) {
+                eq.coef.resize(piv.coef.size(), 0);
+            }
+            for (std::size_t i = 0; i < piv.coef.size(); i++) {
+                eq.coef[i] ^= galMultiply(c, piv.coef[i]);
+            }
+            if (eq.data.size() < piv.data.size()) {
+                eq.data.resize(piv.data.size(), 0);
+            }
+            galMulSliceXorRaw(c, piv.data.data(), eq.data.data(),
+                              piv.data.size());
+            trim(eq.first, eq.coef);
+        }
+        if (eq.coef.empty() || eq.first < low()) {
+            continue; // redundant, or about sources given up on
+        }
+
+        byte c = eq.coef[0];
+        if (c != 1) {
+            byte inv = galDivide(1, c);
+            galMulSliceRaw(inv, eq.coef.data(), eq.coef.data(),
+                           eq.coef.size());
+            galMulSliceRaw(inv, eq.data.data(), eq.data.data(),
+                           eq.data.size());
+        }
+
+        if (eq.coef.size() == 1) {
+            auto data = std::make_shared<std::vector<byte>>(std::move(eq.data));
+            recovered.push_back(data);
+            addKnown(eq.first, data, work);
+        } else {
+            pivots.emplace(eq.first, std::move(eq));
+        }
+    }
+}
@@ -0,0 +1,108 @@
+#ifndef KCP_SLIDING_FEC_H
+#define KCP_SLIDING_FEC_H
+
+#include "fec.h"
+#include <map>
+#include <stdint.h>
+#include <vector>
+
+// Sliding window FEC. Source packets go out unchanged as typeData packets
+// with their own sequence numbers; every so often a repair packet carries
+// a random linear combination over GF(2^8) of the last 'window' source
+// symbols. A symbol is the source packet after the FEC header, i.e. the
+// 2-byte size followed by the payload, as a data shard of the block code.
+//
+// Repair packet: seqid(4) typeRepair(2) first(4) count(2) symbol
+//
+// seqid numbers the repair packets and seeds the coefficients, so they
+// are not sent. first and count give the source packets covered.
+const size_t repairHeaderSize = fecHeaderSize + 6;
+
+// repairCoefficients fills coef with the count nonzero coefficients of
+// repair packet 'repairId'.
+void repairCoefficients(uint32_t repairId, int count, byte *coef);
+
+class slidingEncoder {
+public:
+    slidingEncoder() = default;
+
+    // New creates an encoder sending 'repairs' repair packets after every
+    // 'sources' source packets, each over the last 'window' of them.
+    static slidingEncoder New(int window, int sources, int repairs);
+
+    // MarkData writes the header of the source packet of sz bytes in data
+    // and keeps its symbol for the coming repair packets.
+    void MarkData(byte *data, uint16_t sz);
+
+    // RepairsDue returns the number of repair packets to send now.
+    int RepairsDue() const { return sinceRepair == sources ? repairs : 0; }
+
+    // EncodeRepair writes the next repair packet into buf, which must hold
+    // repairHeaderSize plus the longest symbol, and returns its size.
+    // Once RepairsDue of them are written the count starts over.
+    size_t EncodeRepair(byte *buf);
+
+private:
+    int window{0};
+    int sources{0};
+    int repairs{0};
+    int sinceRepair{0};
+    int repairsSent{0};
+    uint32_t next{0};     // next source seqid
+    uint32_t nextRepair{0};
+    std::vector<std::vector<byte>> history; // last 'window' symbols
+    std::vector<byte> coef;
+};
+
+class slidingDecoder {
+public:
+    slidingDecoder() = default;
+
+    // New creates a decoder for repair windows of up to 'window' packets.
+    static slidingDecoder New(int window);
+
+    // Input a source or repair packet, and return the source symbols it
+    // made recoverable, in no particular order.
+    std::vector<row_type> Input(fecPacket &pkt);
+
+private:
+    // equation says that sum(coef[i] * source[first + i]) is 'data', over
+    // the source packets that are still unknown.
+    struct equation {
+        uint64_t first;
+        std::vector<byte> coef;
+        std::vector<byte> data;
+    };
+
+    struct source {
+        uint64_t tag{0}; // seq + 1, 0 when empty
+        row_type data;
+    };
+
+    // Widens a 32-bit sequence number around the highest one seen.
+    uint64_t extend(uint32_t seq);
+
+    inline const row_type *known(uint64_t seq) const {
+        auto &s = sources[seq & mask];
+        return s.tag == seq + 1 ? &s.data : nullptr;
+    }
+
+    // Lowest sequence number still kept.
+    inline uint64_t low() const {
+        return highest + 1 >= sources.size() ? highest + 1 - sources.size()
+                                             : 0;
+    }
+
+    void addKnown(uint64_t seq, row_type data, std::vector<equation> &work);
+    void solve(std::vector<equation> &work, std::vector<row_type> &recovered);
+    void reduce(equation &eq);
+
+    std::vector<source> sources; // ring of known source symbols
+    uint64_t mask{0};
+    uint64_t highest{0};
+    bool started{false};
+    int window{0};
+    std::map<uint64_t, equation> pivots; // keyed by first unknown, coef 1
+};
+
+#endif // KCP_SLIDING_FEC_H
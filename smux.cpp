@@ -9,16 +9,9 @@ void smux::run() {
 
 void smux::do_keepalive_checker() {
     std::weak_ptr<smux> weaksmux = shared_from_this();
-    if (!keepalive_check_timer_) {
-        keepalive_check_timer_ = std::make_shared<asio::high_resolution_timer>(
-            service_, std::chrono::seconds(FLAGS_keepalive * 3));
-    } else {
-        keepalive_check_timer_->expires_at(
-            keepalive_check_timer_->expires_at() +
-            std::chrono::seconds(FLAGS_keepalive * 3));
-    }
-    keepalive_check_timer_->async_wait(
-        [this, weaksmux](const std::error_code &) {
+    TimingWheel::of(service_).arm(
+        keepalive_check_timer_, uint32_t(FLAGS_keepalive * 3 * 1000),
+        [this, weaksmux] {
             auto s = weaksmux.lock();
             if (!s || is_destroyed()) {
                 return;
@@ -34,16 +27,9 @@ void smux::do_keepalive_checker() {
 
 void smux::do_keepalive_sender() {
     std::weak_ptr<smux> weaksmux = shared_from_this();
-    if (!keepalive_sender_timer_) {
-        keepalive_sender_timer_ = std::make_shared<asio::high_resolution_timer>(
-            service_, std::chrono::seconds(FLAGS_keepalive));
-    } else {
-        keepalive_sender_timer_->expires_at(
-            keepalive_sender_timer_->expires_at() +
-            std::chrono::seconds(FLAGS_keepalive));
-    }
-    keepalive_sender_timer_->async_wait(
-        [this, weaksmux](const std::error_code &) {
+    TimingWheel::of(service_).arm(
+        keepalive_sender_timer_, uint32_t(FLAGS_keepalive * 1000),
+        [this, weaksmux] {
             auto s = weaksmux.lock();
             if (!s || is_destroyed()) {
                 return;
@@ -325,7 +311,8 @@ void smux_sess::async_read_some(char *buf, std::size_t len, Handler handler) {
     return;
 }
 
-static Buffers smux_sess_buffers(4120);
+// frames joined for outputs that take them whole
+static Buffers smux_frame_buffers(4120);
 
 void smux_sess::async_write(char *buf, std::size_t len, Handler handler) {
     if (destroy_) {
@@ -341,16 +328,23 @@ void smux_sess::async_write(char *buf, std::size_t len, Handler handler) {
         }
         return;
     }
-    auto f = frame{version_, cmdPsh, static_cast<uint16_t>(len), id_};
-    auto data = smux_sess_buffers.get();
-    f.marshal(data);
-    memcpy(data + headerSize, buf, len);
-    s->async_write(data, len + headerSize, [handler, data](std::error_code ec, std::size_t sz){
-        smux_sess_buffers.push_back(data);
-        if (handler) {
-            handler(ec, sz);
-        }
-    });
+    s->async_write_frame(frame{version_, cmdPsh, static_cast<uint16_t>(len), id_},
+                         buf, handler);
+    if (is_interactive(len)) {
+        s->flush();
+    }
+}
+
+// Writes up to this size can be keystrokes or their echo.
+static const std::size_t interactiveWriteSize = 512;
+
+bool smux_sess::is_interactive(std::size_t len) {
+    auto now = iclock();
+    auto idle = !written_ || now - last_write_ >= uint32_t(FLAGS_interval);
+    written_ = true;
+    last_write_ = now;
+    // bulk transfers write back to back and in large chunks
+    return FLAGS_fastflush && idle && len <= interactiveWriteSize;
 }
 
 smux_sess::~smux_sess() {
@@ -433,7 +427,22 @@ void smux::async_connect(
 }
 
 void smux::try_output(char *buf, std::size_t len, Handler handler) {
-    tasks_.push_back(Task{buf, len, handler});
+    tasks_.push_back(writeTask{Task{buf, len, handler}, 0, {}});
+    if (!writing_) {
+        writing_ = true;
+        try_write_task();
+    }
+}
+
+void smux::async_write_frame(frame f, char *payload, Handler handler) {
+    if (is_destroyed()) {
+        if (handler) {
+            handler(std::error_code(1, std::generic_category()), 0);
+        }
+        return;
+    }
+    tasks_.push_back(writeTask{Task{payload, f.length, handler}, headerSize, {}});
+    f.marshal(tasks_.back().header);
     if (!writing_) {
         writing_ = true;
         try_write_task();
@@ -446,17 +455,35 @@ void smux::try_write_task() {
         writing_ = false;
         return;
     }
-    auto task = tasks_.front();
-    tasks_.pop_front();
-    output(task.buf, task.len,
-           [this, self, task](std::error_code ec, std::size_t) {
-               if (ec) {
-                   return;
-               }
-               if (task.handler) {
-                   task.handler(ec, task.len);
-               }
-               try_write_task();
+    // the task stays queued until written, as the header lives in it
+    auto &wt = tasks_.front();
+    auto task = wt.task;
+    auto done = [this, self, task](std::error_code ec, std::size_t) {
+        if (ec) {
+            return;
+        }
+        tasks_.pop_front();
+        if (task.handler) {
+            task.handler(ec, task.len);
+        }
+        try_write_task();
+    };
+    if (wt.header_len == 0) {
+        output(task.buf, task.len, done);
+        return;
+    }
+    if (writevHandler_) {
+        Slice slices[2] = {{wt.header, wt.header_len}, {task.buf, task.len}};
+        writevHandler_(slices, 2, done);
+        return;
+    }
+    auto data = smux_frame_buffers.get();
+    memcpy(data, wt.header, wt.header_len);
+    memcpy(data + wt.header_len, task.buf, task.len);
+    output(data, wt.header_len + task.len,
+           [data, done](std::error_code ec, std::size_t sz) {
+               smux_frame_buffers.push_back(data);
+               done(ec, sz);
            });
 }
 
@@ -465,6 +492,9 @@ void smux::call_this_on_destroy() {
 
     Destroy::call_this_on_destroy();
 
+    keepalive_check_timer_.cancel();
+    keepalive_sender_timer_.cancel();
+
     auto read_handler = read_task_.handler;
     auto input_handler = input_task_.handler;
     read_task_.reset();
@@ -2,6 +2,7 @@
 #define KCPTUN_SMUX_H
 
 #include "frame.h"
+#include "timing_wheel.h"
 #include "utils.h"
 
 class smux;
@@ -20,6 +21,9 @@ public:
 
 private:
     void call_this_on_destroy() override;
+    // Interactive writes are small and come after a pause; they are
+    // flushed out at once instead of waiting for the next KCP tick.
+    bool is_interactive(std::size_t len);
 
 private:
     uint8_t version_;
@@ -30,6 +34,8 @@ private:
     Handler input_handler_;
     LinearBuffer input_buffer_;
     std::weak_ptr<smux> sm_;
+    uint32_t last_write_ = 0;
+    bool written_ = false;
 };
 
 class smux final : public std::enable_shared_from_this<smux>,
@@ -47,12 +53,26 @@ public:
         acceptHandler_ = handler;
     }
     void async_write(char *buf, std::size_t len, Handler handler) override;
+    // Writes a frame header and its payload without joining them first.
+    // Without a writev handler they are joined here after all.
+    void async_write_frame(frame f, char *payload, Handler handler);
+    // Called for frames when the output can take them in pieces.
+    void set_writev_handler(WritevHandler handler) { writevHandler_ = handler; }
     void async_connect(
         std::function<void(std::shared_ptr<smux_sess>)> connectHandler);
     void async_write_frame(frame f, Handler handler);
     void async_read_some(char *buf, std::size_t len, Handler handler) override {
     }
     void remove_sess_by_id(uint32_t id) { sessions_.erase(id); }
+    // Called when a stream wants what it wrote sent right away.
+    void set_flush_handler(std::function<void()> handler) {
+        flushHandler_ = handler;
+    }
+    void flush() {
+        if (flushHandler_) {
+            flushHandler_();
+        }
+    }
 
 private:
     void do_keepalive_checker();
@@ -74,11 +94,20 @@ private:
     asio::io_service &service_;
     Task read_task_;
     Task input_task_;
-    std::deque<Task> tasks_;
+    // A write in the queue. When header_len is set the task holds the
+    // payload only, and the header is kept here until it is written.
+    struct writeTask {
+        Task task;
+        std::size_t header_len;
+        char header[headerSize];
+    };
+    std::deque<writeTask> tasks_;
     std::function<void(std::shared_ptr<smux_sess>)> acceptHandler_;
+    std::function<void()> flushHandler_;
+    WritevHandler writevHandler_;
     std::unordered_map<uint32_t, std::weak_ptr<smux_sess>> sessions_;
-    std::shared_ptr<asio::high_resolution_timer> keepalive_check_timer_;
-    std::shared_ptr<asio::high_resolution_timer> keepalive_sender_timer_;
+    TimerNode keepalive_check_timer_;
+    TimerNode keepalive_sender_timer_;
     bool frame_flag = false;
 };
 
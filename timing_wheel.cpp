@@ -0,0 +1,192 @@
+#include "timing_wheel.h"
+
+asio::io_service::id TimingWheel::id;
+
+void TimerNode::cancel() {
+    if (wheel_) {
+        wheel_->unlink(this);
+    }
+    callback_ = nullptr;
+}
+
+TimingWheel::TimingWheel(asio::io_service &service)
+    : asio::io_service::service(service),
+      epoch_(read_monotonic_usec()),
+      timer_(my_make_unique<asio::steady_timer>(service)) {}
+
+TimingWheel::~TimingWheel() { shutdown_service(); }
+
+void TimingWheel::shutdown_service() {
+    for (auto &level : wheel_) {
+        for (auto &head : level) {
+            while (head) {
+                auto node = head;
+                unlink(node);
+                node->callback_ = nullptr;
+            }
+        }
+    }
+    // the timer belongs to a service that may go before this one
+    timer_ = nullptr;
+}
+
+uint64_t TimingWheel::now() const {
+    return (current_monotonic_usec() - epoch_) / 1000;
+}
+
+void TimingWheel::arm(TimerNode &node, uint32_t ms,
+                      std::function<void()> callback) {
+    if (node.wheel_) {
+        unlink(&node);
+    }
+    if (count_ == 0 && !ticking_) {
+        // nothing to run in between, skip the idle ticks
+        current_ = now();
+    }
+    // never into the tick being run
+    node.expire_ = std::max(now() + ms, current_ + 1);
+    node.callback_ = std::move(callback);
+    link(&node);
+    if (timer_ && (wake_ == 0 || node.expire_ < wake_)) {
+        schedule();
+    }
+}
+
+void TimingWheel::arm_earliest(TimerNode &node, uint32_t ms,
+                               std::function<void()> callback) {
+    if (node.wheel_ && node.expire_ <= std::max(now() + ms, current_ + 1)) {
+        return;
+    }
+    arm(node, ms, std::move(callback));
+}
+
+void TimingWheel::link(TimerNode *node) {
+    auto delta = node->expire_ - current_;
+    int level = 0;
+    int shift = 0;
+    uint64_t span = slots;
+    while (delta >= span && level < levels - 1) {
+        level++;
+        shift = rootBits + (level - 1) * levelBits;
+        span = uint64_t(1) << (shift + levelBits);
+    }
+    auto at = node->expire_;
+    if (delta >= span) {
+        // beyond the wheel, parked in the last slot to come round
+        at = current_ + span - 1;
+    }
+    auto mask = level == 0 ? slots - 1 : (1 << levelBits) - 1;
+    auto &head = wheel_[level][(at >> shift) & mask];
+
+    node->wheel_ = this;
+    node->head_ = &head;
+    node->prev_ = nullptr;
+    node->next_ = head;
+    if (head) {
+        head->prev_ = node;
+    }
+    head = node;
+    count_++;
+}
+
+void TimingWheel::unlink(TimerNode *node) {
+    if (node->prev_) {
+        node->prev_->next_ = node->next_;
+    } else {
+        *node->head_ = node->next_;
+    }
+    if (node->next_) {
+        node->next_->prev_ = node->prev_;
+    }
+    node->wheel_ = nullptr;
+    node->head_ = nullptr;
+    node->prev_ = nullptr;
+    node->next_ = nullptr;
+    count_--;
+}
+
+void TimingWheel::cascade(int level, int slot) {
+    auto node = wheel_[level][slot];
+    wheel_[level][slot] = nullptr;
+    while (node) {
+        auto next = node->next_;
+        count_--;
+        link(node);
+        node = next;
+    }
+}
+
+void TimingWheel::tick() {
+    current_++;
+    // bring the coarser levels down as the finer ones come round
+    auto t = current_;
+    if ((t & (slots - 1)) == 0) {
+        auto mask = (uint64_t(1) << levelBits) - 1;
+        auto s1 = int((t >> rootBits) & mask);
+        auto s2 = int((t >> (rootBits + levelBits)) & mask);
+        auto s3 = int((t >> (rootBits + 2 * levelBits)) & mask);
+        if (s1 == 0) {
+            if (s2 == 0) {
+                cascade(3, s3);
+            }
+            cascade(2, s2);
+        }
+        cascade(1, s1);
+    }
+
+    // a callback may arm or cancel any node, this one included
+    auto &head = wheel_[0][t & (slots - 1)];
+    while (head) {
+        auto node = head;
+        unlink(node);
+        auto callback = std::move(node->callback_);
+        node->callback_ = nullptr;
+        if (callback) {
+            callback();
+        }
+    }
+}
+
+void TimingWheel::on_timer() {
+    // the tick waited for is due, even if a coarse clock lags behind
+    auto until = std::max(now(), wake_);
+    wake_ = 0;
+    ticking_ = true;
+    while (current_ < until && count_ > 0) {
+        tick();
+    }
+    ticking_ = false;
+    schedule();
+}
+
+void TimingWheel::schedule() {
+    if (!timer_) {
+        return;
+    }
+    if (count_ == 0) {
+        if (wake_ != 0) {
+            timer_->cancel();
+            wake_ = 0;
+        }
+        return;
+    }
+    // the next due slot of the finest level, or its next turn
+    auto t = current_ + 1;
+    for (; (t & (slots - 1)) != 0; t++) {
+        if (wheel_[0][t & (slots - 1)]) {
+            break;
+        }
+    }
+    if (t == wake_) {
+        return;
+    }
+    wake_ = t;
+    timer_->expires_at(std::chrono::steady_clock::time_point(
+        std::chrono::microseconds(epoch_ + t * 1000)));
+    timer_->async_wait([this](const std::error_code &ec) {
+        if (ec) {
+            return;
+        }
+        on_timer();
+    });
+}
@@ -0,0 +1,81 @@
+#ifndef KCPTUN_TIMING_WHEEL_H
+#define KCPTUN_TIMING_WHEEL_H
+
+#include "utils.h"
+
+class TimingWheel;
+
+// TimerNode is embedded in the object it wakes up. It is armed on the
+// TimingWheel of an io_service, and disarms itself when destroyed.
+class TimerNode final {
+public:
+    TimerNode() = default;
+    ~TimerNode() { cancel(); }
+
+    TimerNode(const TimerNode &) = delete;
+    TimerNode &operator=(const TimerNode &) = delete;
+
+    bool armed() const { return wheel_ != nullptr; }
+    void cancel();
+
+private:
+    friend class TimingWheel;
+
+    TimingWheel *wheel_ = nullptr;
+    TimerNode **head_ = nullptr; // slot the node is linked into
+    TimerNode *prev_ = nullptr;
+    TimerNode *next_ = nullptr;
+    uint64_t expire_ = 0; // in ticks
+    std::function<void()> callback_;
+};
+
+// TimingWheel keeps the timers of one io_service in a hierarchical wheel
+// of millisecond ticks, with a single asio timer to drive it. Arming and
+// cancelling are O(1); a node is moved down a level at most three times
+// before it fires. The driving timer only wakes for due ticks of the
+// finest level, and once per turn of it to bring the coarser ones down.
+class TimingWheel final : public asio::io_service::service {
+public:
+    static asio::io_service::id id;
+
+    explicit TimingWheel(asio::io_service &service);
+    ~TimingWheel();
+
+    static TimingWheel &of(asio::io_service &service) {
+        return asio::use_service<TimingWheel>(service);
+    }
+
+    // Calls 'callback' once after 'ms' milliseconds, replacing whatever
+    // the node was armed with.
+    void arm(TimerNode &node, uint32_t ms, std::function<void()> callback);
+    // As arm, but keeps the node as it is if it fires no later already.
+    void arm_earliest(TimerNode &node, uint32_t ms,
+                      std::function<void()> callback);
+
+private:
+    friend class TimerNode;
+
+    void shutdown_service();
+    uint64_t now() const;
+    void link(TimerNode *node);
+    void unlink(TimerNode *node);
+    void cascade(int level, int slot);
+    void tick();
+    void on_timer();
+    void schedule();
+
+    static const int levels = 4;
+    static const int rootBits = 8;  // 256 ms
+    static const int levelBits = 6; // 64 slots up from there
+    static const int slots = 1 << rootBits;
+
+    TimerNode *wheel_[levels][slots] = {};
+    uint64_t current_ = 0; // last tick run
+    std::size_t count_ = 0;
+    uint64_t epoch_; // in microseconds, see current_monotonic_usec
+    std::unique_ptr<asio::steady_timer> timer_;
+    uint64_t wake_ = 0; // tick the timer waits for, 0 if idle
+    bool ticking_ = false;
+};
+
+#endif
@@ -1,4 +1,23 @@
 #include "utils.h"
+#include "config.h"
+#include <time.h>
+
+thread_local loop_clock_t loop_clock;
+
+uint64_t read_monotonic_usec() {
+#ifdef CLOCK_MONOTONIC_COARSE
+    if (FLAGS_coarseclock) {
+        // same base as steady_clock, a few ms of resolution, no syscall
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+        return uint64_t(ts.tv_sec) * 1000000 + uint64_t(ts.tv_nsec) / 1000;
+    }
+#endif
+    auto now = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               now.time_since_epoch())
+        .count();
+}
 
 void Buffers::push_back(char *buf) {
     bufs_.insert(buf);
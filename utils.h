@@ -60,11 +60,41 @@ my_make_unique(Args &&...) = delete;
 using Handler = std::function<void(std::error_code, std::size_t)>;
 using OutputHandler = std::function<void(char *, std::size_t, Handler)>;
 
+// One piece of a scatter-gather write.
+struct Slice {
+    const char *buf;
+    std::size_t len;
+};
+// Writes the slices in order as if they were one buffer. The slices
+// must stay valid until the handler is called.
+using WritevHandler = std::function<void(const Slice *, std::size_t, Handler)>;
+
+// The monotonic clock in microseconds, on the steady_clock time base.
+// With --coarseclock it is read from CLOCK_MONOTONIC_COARSE where there
+// is one.
+uint64_t read_monotonic_usec();
+
+// A thread running an EventLoop reads the clock once per iteration and
+// serves later reads from here, see EventLoop::run. Other threads always
+// read it afresh.
+struct loop_clock_t {
+    bool enabled;
+    bool valid;
+    uint64_t usec;
+};
+extern thread_local loop_clock_t loop_clock;
+
 static inline uint64_t
 current_monotonic_usec()
 {
-    auto now = std::chrono::steady_clock::now();
-    auto us = std::chrono::duration_cast<std::chrono::microseconds>(now.time_since_epoch()).count();
+    if (loop_clock.valid) {
+        return loop_clock.usec;
+    }
+    auto us = read_monotonic_usec();
+    if (loop_clock.enabled) {
+        loop_clock.valid = true;
+        loop_clock.usec = us;
+    }
     return us;
 }
 
@@ -235,6 +265,7 @@ public:
             usocket_.async_send_to(asio::buffer(buf, len), ep_, handler);
         }
     }
+    asio::ip::udp::socket &socket() { return usocket_; }
 
 private:
     bool connected_ = false;
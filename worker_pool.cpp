@@ -0,0 +1,83 @@
+#include "worker_pool.h"
+#include "config.h"
+
+static kvar offload_kvar("FECOffload");
+
+WorkerPool::WorkerPool(int threads) {
+    for (int i = 0; i < threads; i++) {
+        threads_.emplace_back([this] { run(); });
+    }
+}
+
+WorkerPool::~WorkerPool() {
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        stopped_ = true;
+    }
+    cv_.notify_all();
+    for (auto &t : threads_) {
+        t.join();
+    }
+}
+
+void WorkerPool::submit(std::function<void()> job) {
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        jobs_.push_back(std::move(job));
+    }
+    cv_.notify_one();
+}
+
+void WorkerPool::run() {
+    for (;;) {
+        std::function<void()> job;
+        {
+            std::unique_lock<std::mutex> lock(mu_);
+            cv_.wait(lock, [this] { return stopped_ || !jobs_.empty(); });
+            if (jobs_.empty()) {
+                return;
+            }
+            job = std::move(jobs_.front());
+            jobs_.pop_front();
+        }
+        job();
+    }
+}
+
+WorkerPool &WorkerPool::fec() {
+    static WorkerPool pool(std::max(1, FLAGS_fecworkers));
+    return pool;
+}
+
+void OffloadQueue::submit(std::function<void()> job,
+                          std::function<void()> done) {
+    offload_kvar.add(1);
+    jobs_.emplace_back(std::move(job), std::move(done));
+    if (!running_) {
+        run_next();
+    }
+}
+
+void OffloadQueue::run_next() {
+    if (jobs_.empty()) {
+        running_ = false;
+        return;
+    }
+    running_ = true;
+    auto self = shared_from_this();
+    auto job = std::move(jobs_.front().first);
+    // Keeps run() from returning while the job is out.
+    auto work = std::make_shared<asio::io_service::work>(service_);
+    pool_.submit([this, self, job, work] {
+        job();
+        service_.post([this, self, work] {
+            auto done = std::move(jobs_.front().second);
+            jobs_.pop_front();
+            offload_kvar.sub(1);
+            run_next();
+            if (done) {
+                done();
+            }
+        });
+    });
+}
@@ -0,0 +1,56 @@
+#ifndef KCPTUN_WORKER_POOL_H
+#define KCPTUN_WORKER_POOL_H
+
+#include "utils.h"
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+// WorkerPool runs jobs on a fixed set of threads. Jobs must not touch
+// anything owned by an io_service; results go back through OffloadQueue.
+class WorkerPool final {
+public:
+    explicit WorkerPool(int threads);
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool &) = delete;
+    WorkerPool &operator=(const WorkerPool &) = delete;
+
+    void submit(std::function<void()> job);
+
+    // The pool shared by the FEC stages, started with --fecworkers threads
+    // on first use.
+    static WorkerPool &fec();
+
+private:
+    void run();
+
+    std::mutex mu_;
+    std::condition_variable cv_;
+    std::deque<std::function<void()>> jobs_;
+    std::vector<std::thread> threads_;
+    bool stopped_ = false;
+};
+
+// OffloadQueue runs the jobs of one owner on a WorkerPool one at a time,
+// in the order given, and each completion on the owner's io_service in the
+// same order. State used only by the jobs needs no locking.
+class OffloadQueue final : public std::enable_shared_from_this<OffloadQueue> {
+public:
+    OffloadQueue(asio::io_service &service, WorkerPool &pool)
+        : service_(service), pool_(pool) {}
+
+    // Must be called on the io_service thread.
+    void submit(std::function<void()> job, std::function<void()> done);
+
+private:
+    void run_next();
+
+    asio::io_service &service_;
+    WorkerPool &pool_;
+    std::deque<std::pair<std::function<void()>, std::function<void()>>> jobs_;
+    bool running_ = false;
+};
+
+#endif